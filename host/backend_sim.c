@@ -0,0 +1,360 @@
+#include <math.h>
+#include <string.h>
+
+#include "sim.h"
+
+//Power-on values of the simulated TMP451
+#define SIM_DEFAULT_RATE        0x08    // 16 Hz
+#define SIM_DEFAULT_SOC_HIGH    85
+
+#define SIM_NOISE_PERIOD        1000000000ULL   // A new noise value every simulated second
+
+static u8 simRegisters[256];
+static u32 simRegisterWrites[256];
+static u32 simRegisterReads[256];
+static u8 simStatusLatched;
+
+static SimState simState;
+static u64 simDurationNs;
+static SimStepFunction simStep;
+static u64 simMaxStepNs;
+static void *simStepUser;
+static SimSleepCallback simSleepCallback;
+static void *simSleepUser;
+static float simNoiseSigma;
+static u32 simNoiseSeed;
+
+static Mutex simMutex;
+static Event simFinishedEvent;
+static bool simFinished;
+
+static void SimEncodeTemp(float temperature, u8 *integer, u8 *decimals)
+{
+    // Truncated to the sensor's 1/16 oC resolution, standard 0..127 range
+    int sixteenths = (int)(temperature * 16.0f);
+    if (sixteenths < 0)
+        sixteenths = 0;
+    if (sixteenths > 127 * 16 + 15)
+        sixteenths = 127 * 16 + 15;
+
+    *integer = (u8)(sixteenths >> 4);
+    *decimals = (u8)((sixteenths & 0xF) << 4);
+}
+
+static u8 SimSocStatus()
+{
+    u8 status = 0;
+    int socSixteenths = simRegisters[SIM_REG_SOC_TEMP] * 16 + (simRegisters[SIM_REG_SOC_TEMP_DEC] >> 4);
+    int highSixteenths = simRegisters[SIM_REG_SOC_HIGH_READ] * 16 + (simRegisters[SIM_REG_SOC_HIGH_DEC] >> 4);
+    int lowSixteenths = simRegisters[SIM_REG_SOC_LOW_READ] * 16 + (simRegisters[SIM_REG_SOC_LOW_DEC] >> 4);
+
+    if (socSixteenths > highSixteenths)
+        status |= SIM_STATUS_SOC_HIGH;
+    if (socSixteenths <= lowSixteenths)
+        status |= SIM_STATUS_SOC_LOW;
+
+    return status;
+}
+
+// splitmix64 of the seed, the sensor and the period, mapped to (0, 1]
+static double SimNoiseUniform(u64 key)
+{
+    u64 z = key + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return ((z >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+// Box-Muller on two draws for this sensor and period
+static float SimSensorNoise(u32 sensor)
+{
+    if (simNoiseSigma <= 0)
+        return 0.0f;
+
+    u64 key = ((u64)simNoiseSeed << 40) + ((simState.timeNs / SIM_NOISE_PERIOD) << 2) + ((u64)sensor << 1);
+    double u1 = SimNoiseUniform(key);
+    double u2 = SimNoiseUniform(key + 1);
+    return simNoiseSigma * (float)(sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2));
+}
+
+// Called with simMutex held after the temperatures changed
+static void SimUpdateRegisters()
+{
+    SimEncodeTemp(simState.socTemp + SimSensorNoise(0), &simRegisters[SIM_REG_SOC_TEMP], &simRegisters[SIM_REG_SOC_TEMP_DEC]);
+    SimEncodeTemp(simState.pcbTemp + SimSensorNoise(1), &simRegisters[SIM_REG_PCB_TEMP], &simRegisters[SIM_REG_PCB_TEMP_DEC]);
+    simStatusLatched |= SimSocStatus();
+}
+
+static u8 SimReadRegister(u8 reg)
+{
+    simRegisterReads[reg]++;
+
+    if (reg == SIM_REG_STATUS) {
+        // Latched bits clear on read, conditions still present set them again
+        u8 status = simStatusLatched;
+        simStatusLatched = SimSocStatus();
+        return status;
+    }
+
+    return simRegisters[reg];
+}
+
+static void SimWriteRegister(u8 reg, u8 val)
+{
+    simRegisterWrites[reg]++;
+
+    switch (reg) {
+        case SIM_REG_CONFIG_WRITE:
+            simRegisters[SIM_REG_CONFIG_READ] = val;
+            break;
+        case SIM_REG_RATE_WRITE:
+            simRegisters[SIM_REG_RATE_READ] = val;
+            break;
+        case SIM_REG_SOC_HIGH_WRITE:
+            simRegisters[SIM_REG_SOC_HIGH_READ] = val;
+            break;
+        case SIM_REG_SOC_LOW_WRITE:
+            simRegisters[SIM_REG_SOC_LOW_READ] = val;
+            break;
+        case SIM_REG_SOC_HIGH_DEC:
+        case SIM_REG_SOC_LOW_DEC:
+            simRegisters[reg] = val & 0xF0;
+            break;
+        default:
+            // Read-only on the real part, writes are ignored
+            break;
+    }
+}
+
+static Result SimSensorReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+    mutexLock(&simMutex);
+    if (R_FAILED(simState.sensorError)) {
+        Result rc = simState.sensorError;
+        simState.sensorError = 0;
+        mutexUnlock(&simMutex);
+        return rc;
+    }
+    for (size_t i = 0; i < count; i++) {
+        out[i] = SimReadRegister(regs[i]);
+    }
+    mutexUnlock(&simMutex);
+    return 0;
+}
+
+static Result SimSensorWriteRegs(const u8 *regs, const u8 *vals, size_t count)
+{
+    mutexLock(&simMutex);
+    for (size_t i = 0; i < count; i++) {
+        SimWriteRegister(regs[i], vals[i]);
+    }
+    mutexUnlock(&simMutex);
+    return 0;
+}
+
+static void SimSensorClose()
+{
+}
+
+static Result SimFanOpen()
+{
+    return 0;
+}
+
+static Result SimFanSetLevel(float level)
+{
+    mutexLock(&simMutex);
+    simState.fanLevel = level;
+    mutexUnlock(&simMutex);
+    return 0;
+}
+
+static Result SimFanGetLevel(float *level)
+{
+    mutexLock(&simMutex);
+    *level = simState.fanLevel;
+    mutexUnlock(&simMutex);
+    return 0;
+}
+
+static void SimFanClose()
+{
+}
+
+static u64 SimGetTick()
+{
+    mutexLock(&simMutex);
+    u64 timeNs = simState.timeNs;
+    mutexUnlock(&simMutex);
+
+    // 19.2 MHz is exactly 12 ticks per 625 ns
+    return (timeNs / 625) * 12 + (timeNs % 625) * 12 / 625;
+}
+
+static u64 SimGetTickFrequency()
+{
+    return SIM_TICK_FREQUENCY;
+}
+
+static void SimAdvance(u64 timeoutNs)
+{
+    mutexLock(&simMutex);
+
+    u64 remaining = simState.timeNs + timeoutNs > simDurationNs ? simDurationNs - simState.timeNs : timeoutNs;
+    while (remaining > 0) {
+        u64 dt = (simStep && simMaxStepNs && remaining > simMaxStepNs) ? simMaxStepNs : remaining;
+        if (simStep)
+            simStep(&simState, dt, simStepUser);
+        simState.timeNs += dt;
+        remaining -= dt;
+        SimUpdateRegisters();
+    }
+
+    bool finished = simState.timeNs >= simDurationNs;
+    mutexUnlock(&simMutex);
+
+    if (finished && !simFinished) {
+        simFinished = true;
+        eventFire(&simFinishedEvent);
+    }
+}
+
+// Time only passes when the controller sleeps out its full timeout. A wake
+// that is already pending returns at once, as it would on the console.
+static void SimWaitForWakeup(Event *event, u64 timeoutNs)
+{
+    if (simSleepCallback) {
+        SimState state;
+        SimGetState(&state);
+        simSleepCallback(&state, timeoutNs, simSleepUser);
+    }
+
+    if (event && R_SUCCEEDED(eventWait(event, 0)))
+        return;
+
+    SimAdvance(timeoutNs);
+
+    // Past the end the controller idles until it is woken to shut down
+    if (simFinished) {
+        if (event) {
+            eventWait(event, UINT64_MAX);
+        } else {
+            svcSleepThread(1000000);
+        }
+    }
+}
+
+static bool SimIsInFocus()
+{
+    mutexLock(&simMutex);
+    bool inFocus = simState.inFocus;
+    mutexUnlock(&simMutex);
+    return inFocus;
+}
+
+const FanControllerBackend fanControllerDefaultBackend = {
+    .sensorReadRegs = SimSensorReadRegs,
+    .sensorWriteRegs = SimSensorWriteRegs,
+    .sensorClose = SimSensorClose,
+    .sensorGetSessionStats = NULL,
+    .fanOpen = SimFanOpen,
+    .fanSetLevel = SimFanSetLevel,
+    .fanGetLevel = SimFanGetLevel,
+    .fanClose = SimFanClose,
+    .getTick = SimGetTick,
+    .getTickFrequency = SimGetTickFrequency,
+    .waitForWakeup = SimWaitForWakeup,
+    .isInFocus = SimIsInFocus,
+};
+
+void SimInit(const SimState *initial, u64 durationNs)
+{
+    static bool simEventCreated = false;
+    if (!simEventCreated) {
+        eventCreate(&simFinishedEvent, false);
+        simEventCreated = true;
+    }
+    eventClear(&simFinishedEvent);
+    simFinished = false;
+
+    mutexLock(&simMutex);
+    simState = *initial;
+    simState.timeNs = 0;
+    simDurationNs = durationNs;
+
+    memset(simRegisters, 0, sizeof(simRegisters));
+    memset(simRegisterWrites, 0, sizeof(simRegisterWrites));
+    memset(simRegisterReads, 0, sizeof(simRegisterReads));
+    simRegisters[SIM_REG_RATE_READ] = SIM_DEFAULT_RATE;
+    simRegisters[SIM_REG_SOC_HIGH_READ] = SIM_DEFAULT_SOC_HIGH;
+    simStatusLatched = 0;
+    SimUpdateRegisters();
+    mutexUnlock(&simMutex);
+}
+
+void SimSetStepFunction(SimStepFunction step, u64 maxStepNs, void *user)
+{
+    mutexLock(&simMutex);
+    simStep = step;
+    simMaxStepNs = maxStepNs;
+    simStepUser = user;
+    mutexUnlock(&simMutex);
+}
+
+void SimSetSleepCallback(SimSleepCallback callback, void *user)
+{
+    simSleepCallback = callback;
+    simSleepUser = user;
+}
+
+void SimSetSensorNoise(float sigma, u32 seed)
+{
+    mutexLock(&simMutex);
+    simNoiseSigma = sigma;
+    simNoiseSeed = seed;
+    mutexUnlock(&simMutex);
+}
+
+void SimGetState(SimState *out)
+{
+    mutexLock(&simMutex);
+    *out = simState;
+    mutexUnlock(&simMutex);
+}
+
+void SimSetInFocus(bool inFocus)
+{
+    mutexLock(&simMutex);
+    simState.inFocus = inFocus;
+    mutexUnlock(&simMutex);
+}
+
+u8 SimPeekRegister(u8 reg)
+{
+    mutexLock(&simMutex);
+    u8 val = simRegisters[reg];
+    mutexUnlock(&simMutex);
+    return val;
+}
+
+u32 SimGetRegisterWrites(u8 reg)
+{
+    mutexLock(&simMutex);
+    u32 writes = simRegisterWrites[reg];
+    mutexUnlock(&simMutex);
+    return writes;
+}
+
+u32 SimGetRegisterReads(u8 reg)
+{
+    mutexLock(&simMutex);
+    u32 reads = simRegisterReads[reg];
+    mutexUnlock(&simMutex);
+    return reads;
+}
+
+void SimWaitFinished()
+{
+    eventWait(&simFinishedEvent, UINT64_MAX);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//Minimal checks for the host tests: a failed CHECK is reported and counted,
+//the test keeps going, and CheckExit turns the count into the exit status.
+
+static int checkFailures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            checkFailures++; \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+// Like CHECK, with both sides printed as unsigned integers
+#define CHECK_EQ(actual, expected) \
+    do { \
+        unsigned long long checkActual = (unsigned long long)(actual); \
+        unsigned long long checkExpected = (unsigned long long)(expected); \
+        if (checkActual != checkExpected) { \
+            checkFailures++; \
+            fprintf(stderr, "%s:%d: check failed: %s == %s (%llu != %llu)\n", \
+                    __FILE__, __LINE__, #actual, #expected, checkActual, checkExpected); \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do { \
+        int checkBefore = checkFailures; \
+        test(); \
+        printf("%-40s %s\n", #test, checkFailures == checkBefore ? "ok" : "FAILED"); \
+    } while (0)
+
+static inline int CheckExit()
+{
+    if (checkFailures)
+        fprintf(stderr, "%d check(s) failed\n", checkFailures);
+    return checkFailures ? 1 : 0;
+}
+
+//The controller writes its config and logs under ./config, so tests that start
+//it run in a scratch directory that is removed afterwards
+static char checkScratchDir[] = "/tmp/fancontrol-test-XXXXXX";
+
+static inline void CheckEnterScratchDir()
+{
+    if (!mkdtemp(checkScratchDir) || chdir(checkScratchDir) != 0) {
+        fprintf(stderr, "Can't create a scratch directory\n");
+        exit(1);
+    }
+}
+
+static inline void CheckLeaveScratchDir()
+{
+    if (chdir("/") != 0)
+        return;
+
+    char command[sizeof(checkScratchDir) + 16];
+    snprintf(command, sizeof(command), "rm -rf '%s'", checkScratchDir);
+    if (system(command) != 0)
+        fprintf(stderr, "Can't remove %s\n", checkScratchDir);
+}
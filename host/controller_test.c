@@ -0,0 +1,724 @@
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "check.h"
+#include "fancontrol.h"
+#include "fantrace.h"
+#include "sim.h"
+
+//The controller thread against the simulated backend: register-level effects
+//of its sampling decisions, checked on the virtual clock
+
+static const TemperaturePoint testTable[] =
+{
+    { .temperature_c = 20, .fanLevel_f = 0.10 },
+    { .temperature_c = 35, .fanLevel_f = 0.35 },
+    { .temperature_c = 45, .fanLevel_f = 0.55 },
+    { .temperature_c = 55, .fanLevel_f = 0.75 },
+    { .temperature_c = 70, .fanLevel_f = 1.00 }
+};
+
+#define TEST_POINT_COUNT (sizeof(testTable) / sizeof(testTable[0]))
+#define TEST_MAX_SLEEPS 4096
+#define NORMAL_TEST_INTERVAL 5000000000ULL     // Longer than any emergency or ramp step
+
+typedef struct
+{
+    u64     timeNs;
+    u64     timeoutNs;
+    u8      rate;       // Conversion rate register when the controller went to sleep
+} SleepRecord;
+
+static SleepRecord sleeps[TEST_MAX_SLEEPS];
+static u32 sleepCount;
+
+static void RecordSleep(const SimState *state, u64 timeoutNs, void *user)
+{
+    (void)user;
+
+    if (sleepCount < TEST_MAX_SLEEPS) {
+        sleeps[sleepCount++] = (SleepRecord) {
+            .timeNs = state->timeNs,
+            .timeoutNs = timeoutNs,
+            .rate = SimPeekRegister(SIM_REG_RATE_READ),
+        };
+    }
+}
+
+// The controller takes ownership of the table and frees it on close
+static void StartControllerWithCurve(const TemperaturePoint *curve, u32 pointCount,
+                                     const FanControllerOptions *options)
+{
+    TemperaturePoint *table = malloc(pointCount * sizeof(TemperaturePoint));
+    memcpy(table, curve, pointCount * sizeof(TemperaturePoint));
+
+    InitFanControllerWithOptions(table, pointCount, options);
+    StartFanControllerThread();
+}
+
+static void StartController(const FanControllerOptions *options)
+{
+    StartControllerWithCurve(testTable, TEST_POINT_COUNT, options);
+}
+
+static void DefaultTestOptions(FanControllerOptions *options)
+{
+    GetDefaultFanControllerOptions(options);
+    options->binaryLog = false;
+}
+
+// Rate code from the datasheet: 0.0625 Hz doubling per step, so the period is
+// 16 s >> code. The slowest rate that converts twice per interval is expected.
+static u8 ExpectedRate(u64 intervalNs)
+{
+    u8 code = 0;
+    while (code < 7 && (16000000000ULL >> code) > intervalNs / 2)
+        code++;
+    return code;
+}
+
+// Idle, a spell near the emergency threshold, idle again, then sleep mode
+static void RateTestStep(SimState *state, u64 dtNs, void *user)
+{
+    (void)user;
+    double time_s = (state->timeNs + dtNs) / 1e9;
+
+    state->socTemp = (time_s >= 400 && time_s < 500) ? 85.0f : 45.0f;
+    state->inFocus = time_s < 800;
+}
+
+static void TestConversionRateFollowsInterval()
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, 2000000000000ULL);
+    SimSetStepFunction(RateTestStep, 1000000000ULL, NULL);
+    SimSetSleepCallback(RecordSleep, NULL);
+    sleepCount = 0;
+
+    u8 powerOnRate = SimPeekRegister(SIM_REG_RATE_READ);
+
+    StartController(&options);
+    SimWaitFinished();
+    CloseFanControllerThread();
+    SimSetSleepCallback(NULL, NULL);
+
+    // Every sleep runs at the rate programmed for its interval, and the
+    // register is only written when that rate changes
+    u32 changes = 0;
+    bool tiers[8] = {0};
+    for (u32 i = 0; i < sleepCount; i++) {
+        CHECK_EQ(sleeps[i].rate, ExpectedRate(sleeps[i].timeoutNs));
+        if (i == 0 || sleeps[i].rate != sleeps[i - 1].rate)
+            changes++;
+        tiers[sleeps[i].rate & 7] = true;
+    }
+
+    // 5 s, 10 s and 30 s while idle, 2 s near the threshold, 300 s asleep
+    CHECK(tiers[ExpectedRate(5000000000ULL)]);
+    CHECK(tiers[ExpectedRate(10000000000ULL)]);
+    CHECK(tiers[ExpectedRate(30000000000ULL)]);
+    CHECK(tiers[ExpectedRate(2000000000ULL)]);
+    CHECK(tiers[ExpectedRate(300000000000ULL)]);
+
+    // Closing restores what the system had configured
+    CHECK_EQ(SimPeekRegister(SIM_REG_RATE_READ), powerOnRate);
+    CHECK_EQ(SimGetRegisterWrites(SIM_REG_RATE_WRITE), changes + 1);
+}
+
+// Log times are relative to the header's start tick, which is taken at init:
+// the first batch only reaches storage after many samples
+static void TestLogStartsAtInit()
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+    options.binaryLog = true;
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, 3600000000000ULL);
+    SimSetStepFunction(NULL, 0, NULL);
+
+    StartController(&options);
+    SimWaitFinished();
+    CloseFanControllerThread();
+
+    FanLogHeader header = {0};
+    FanLogRecord first = {0};
+    FILE *log = fopen(LOG_FILE, "rb");
+    CHECK(log != NULL);
+    if (!log)
+        return;
+
+    CHECK_EQ(fread(&header, sizeof(header), 1, log), 1);
+    CHECK_EQ(fread(&first, sizeof(first), 1, log), 1);
+    fclose(log);
+
+    CHECK_EQ(header.magic, FANLOG_MAGIC);
+    CHECK_EQ(header.startTick, 0);
+    CHECK(first.tick >= header.startTick);
+    CHECK(first.tick - header.startTick < header.tickFrequency);
+}
+
+// Idle until 100 s, then critical
+static void CriticalStep(SimState *state, u64 dtNs, void *user)
+{
+    (void)user;
+    state->socTemp = state->timeNs + dtNs > 100000000000ULL ? 92.0f : 45.0f;
+}
+
+static u64 firstEmergencySleepNs;
+
+static void RecordEmergencySleep(const SimState *state, u64 timeoutNs, void *user)
+{
+    (void)user;
+    if (timeoutNs <= 2000000000ULL && firstEmergencySleepNs == 0)
+        firstEmergencySleepNs = state->timeNs;
+}
+
+// A filter that lags, here an EMA with a weight of 0 that init clamps to the
+// minimum, must not hold back the emergency response
+static void TestEmergencyIgnoresFilterLag()
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+    options.filters[0].type = SensorFilter_Ema;
+    options.filters[0].emaAlpha = 0.0f;
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, 300000000000ULL);
+    SimSetStepFunction(CriticalStep, 1000000000ULL, NULL);
+    SimSetSleepCallback(RecordEmergencySleep, NULL);
+    firstEmergencySleepNs = 0;
+
+    StartController(&options);
+    SimWaitFinished();
+    CloseFanControllerThread();
+    SimSetSleepCallback(NULL, NULL);
+
+    // Noticed on the first sample after the step, at most one stable interval late
+    CHECK(firstEmergencySleepNs > 100000000000ULL);
+    CHECK(firstEmergencySleepNs <= 131000000000ULL);
+
+    // The clamped weight still lets the filtered reading catch up with the curve
+    SimState final;
+    SimGetState(&final);
+    CHECK(final.fanLevel == 1.0f);
+}
+
+//Stall watch against a first-order SOC: heat in, conduction out through a
+//heatsink the fan helps only while it moves air. The curve is flat so the fan
+//level stays put and only the temperature trend decides.
+#define STALL_TEST_FAN_LEVEL 0.6f
+
+static const TemperaturePoint flatTable[] =
+{
+    { .temperature_c = 20, .fanLevel_f = STALL_TEST_FAN_LEVEL },
+    { .temperature_c = 70, .fanLevel_f = STALL_TEST_FAN_LEVEL }
+};
+
+typedef struct
+{
+    double  stepAt_s;           // Power goes from 6 W to 10 W here
+    double  stallAt_s;          // Fan moves no air from here...
+    double  recoverAt_s;        // ...until here
+    float   capacity;           // J/oC of the SOC and heatsink
+} StallPlant;
+
+static void StallPlantStep(SimState *state, u64 dtNs, void *user)
+{
+    const StallPlant *plant = (const StallPlant *)user;
+    double time_s = state->timeNs / 1e9;
+    double dt = dtNs / 1e9;
+
+    bool stalled = time_s >= plant->stallAt_s && time_s < plant->recoverAt_s;
+    float power = time_s >= plant->stepAt_s ? 10.0f : 6.0f;
+    float conductance = 0.1f + (stalled ? 0.0f : 0.4f * state->fanLevel);
+
+    state->socTemp += (power - conductance * (state->socTemp - 25.0f)) * dt / plant->capacity;
+}
+
+typedef struct
+{
+    u64     cursor;
+    double  firstStall_s;       // Sample times, 0 if never seen
+    double  lastStall_s;
+    bool    fullSpeedWhileStalled;
+    float   levelBeforeStall;   // Commanded by the curve on the sample before the first stall
+    float   lastLevel;
+} StallRecord;
+
+static void RecordStall(const SimState *state, u64 timeoutNs, void *user)
+{
+    (void)state;
+    (void)timeoutNs;
+
+    StallRecord *record = (StallRecord *)user;
+    FanControllerSample samples[FAN_TELEMETRY_RING_SIZE];
+    size_t count;
+
+    while ((count = FanControllerReadSamples(&record->cursor, samples, FAN_TELEMETRY_RING_SIZE)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (!(samples[i].flags & FAN_SAMPLE_FLAG_FAN_STALLED)) {
+                record->lastLevel = samples[i].fanLevel;
+                continue;
+            }
+
+            double time_s = (double)samples[i].tick / SIM_TICK_FREQUENCY;
+            if (record->firstStall_s == 0) {
+                record->firstStall_s = time_s;
+                record->levelBeforeStall = record->lastLevel;
+                record->fullSpeedWhileStalled = true;
+            }
+            record->lastStall_s = time_s;
+            if (samples[i].fanLevel != 1.0f)
+                record->fullSpeedWhileStalled = false;
+        }
+    }
+}
+
+static void RunStallPlantWithCurve(const TemperaturePoint *curve, u32 pointCount,
+                                   StallPlant *plant, StallRecord *record, u64 durationNs)
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+
+    // Settled at 6 W with the fan at its flat level
+    SimState initial = { .socTemp = 25.0f + 6.0f / (0.1f + 0.4f * STALL_TEST_FAN_LEVEL),
+                         .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, durationNs);
+    SimSetStepFunction(StallPlantStep, 1000000000ULL, plant);
+
+    // Samples left in the ring by an earlier run belong to it
+    FanControllerSample discarded[FAN_TELEMETRY_RING_SIZE];
+    while (FanControllerReadSamples(&record->cursor, discarded, FAN_TELEMETRY_RING_SIZE) > 0)
+        ;
+    SimSetSleepCallback(RecordStall, record);
+
+    StartControllerWithCurve(curve, pointCount, &options);
+    SimWaitFinished();
+    CloseFanControllerThread();
+    SimSetSleepCallback(NULL, NULL);
+    SimSetStepFunction(NULL, 0, NULL);
+}
+
+static void RunStallPlant(StallPlant *plant, StallRecord *record, u64 durationNs)
+{
+    RunStallPlantWithCurve(flatTable, sizeof(flatTable) / sizeof(flatTable[0]), plant, record, durationNs);
+}
+
+// A load step with a working fan climbs fast but settles within a window
+static void TestLoadStepIsNotStall()
+{
+    StallPlant plant = { .stepAt_s = 300, .stallAt_s = 1e9, .recoverAt_s = 1e9, .capacity = 20 };
+    StallRecord record = {0};
+
+    RunStallPlant(&plant, &record, 1800000000000ULL);
+
+    CHECK(record.firstStall_s == 0);
+}
+
+// A fan that stops moving air is caught after two rising windows, the first
+// of which may start a stable interval before the stall, run at full speed,
+// and let go once it cools the SOC again
+static void TestStalledFanForcedToFullSpeed()
+{
+    StallPlant plant = { .stepAt_s = 1e9, .stallAt_s = 300, .recoverAt_s = 900, .capacity = 20 };
+    StallRecord record = {0};
+
+    RunStallPlant(&plant, &record, 1800000000000ULL);
+
+    CHECK(record.firstStall_s >= 510);
+    CHECK(record.firstStall_s <= 600);
+    CHECK(record.fullSpeedWhileStalled);
+    CHECK(record.lastStall_s >= 900);
+    CHECK(record.lastStall_s <= 960);
+}
+
+// On a sloped curve the heat from a stalled fan makes the curve raise the
+// level, which must neither hide the stall nor leave it to the full-speed
+// plateau. A load step on the same curve is still no stall.
+static void TestStallCaughtOnSlopedCurve()
+{
+    StallPlant stall = { .stepAt_s = 1e9, .stallAt_s = 600, .recoverAt_s = 1e9, .capacity = 60 };
+    StallPlant step = { .stepAt_s = 600, .stallAt_s = 1e9, .recoverAt_s = 1e9, .capacity = 60 };
+    StallRecord record = {0};
+
+    RunStallPlantWithCurve(testTable, TEST_POINT_COUNT, &stall, &record, 1800000000000ULL);
+
+    CHECK(record.firstStall_s > 600);
+    CHECK(record.firstStall_s <= 900);
+    CHECK(record.levelBeforeStall >= 0.5f);
+    CHECK(record.levelBeforeStall < 1.0f);
+    CHECK(record.fullSpeedWhileStalled);
+
+    memset(&record, 0, sizeof(record));
+    RunStallPlantWithCurve(testTable, TEST_POINT_COUNT, &step, &record, 1800000000000ULL);
+
+    CHECK(record.firstStall_s == 0);
+}
+
+//Dual-sensor plant: the SOC holds still on its curve while the PCB warms up
+//over ten minutes. Fused by max, the PCB curve takes the fan past where the
+//SOC alone would leave it, without reading the PCB more often than asked.
+#define FUSION_TEST_PCB_INTERVAL 60000000000ULL
+
+static const TemperaturePoint pcbTestTable[] =
+{
+    { .temperature_c = 40, .fanLevel_f = 0.20 },
+    { .temperature_c = 60, .fanLevel_f = 1.00 }
+};
+
+static void PcbWarmupStep(SimState *state, u64 dtNs, void *user)
+{
+    (void)user;
+
+    double time_s = (state->timeNs + dtNs) / 1e9;
+    state->pcbTemp = 35.0f + 25.0f * (float)fmin(time_s / 600.0, 1.0);
+}
+
+static FanControllerBackend pcbCountingBackend;
+static u32 pcbReads;
+static u64 lastPcbReadNs;
+static u64 minPcbReadGapNs;
+
+static Result PcbCountingSensorReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (regs[i] != SIM_REG_PCB_TEMP)
+            continue;
+
+        SimState state;
+        SimGetState(&state);
+        if (pcbReads > 0 && state.timeNs - lastPcbReadNs < minPcbReadGapNs)
+            minPcbReadGapNs = state.timeNs - lastPcbReadNs;
+        lastPcbReadNs = state.timeNs;
+        pcbReads++;
+        break;
+    }
+
+    return fanControllerDefaultBackend.sensorReadRegs(regs, count, out);
+}
+
+static void TestFusionFollowsSlowPcb()
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+    options.fusion = SensorFusion_Max;
+    options.pcbSampleInterval = FUSION_TEST_PCB_INTERVAL;
+
+    pcbCountingBackend = fanControllerDefaultBackend;
+    pcbCountingBackend.sensorReadRegs = PcbCountingSensorReadRegs;
+    FanControllerSetBackend(&pcbCountingBackend);
+    pcbReads = 0;
+    minPcbReadGapNs = UINT64_MAX;
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, 1200000000000ULL);
+    SimSetStepFunction(PcbWarmupStep, 1000000000ULL, NULL);
+
+    // Init leaves the PCB curve alone and close clears it, so it goes in between
+    CHECK(FanControllerSetPcbCurve(pcbTestTable, sizeof(pcbTestTable) / sizeof(pcbTestTable[0])));
+    StartController(&options);
+    SimWaitFinished();
+
+    FanControllerSample sample;
+    u64 cursor = 0;
+    while (FanControllerReadSamples(&cursor, &sample, 1) > 0)
+        ;
+    CloseFanControllerThread();
+    SimSetStepFunction(NULL, 0, NULL);
+    FanControllerSetBackend(NULL);
+
+    // SOC alone would hold 0.55, the hot PCB asks for full speed
+    CHECK(sample.pcbTemp >= 59.0f);
+    CHECK(sample.fanLevel == 1.0f);
+    CHECK(SimPeekRegister(SIM_REG_PCB_TEMP) >= 59);
+
+    CHECK(pcbReads >= 10);
+    CHECK(pcbReads <= 1200000000000ULL / FUSION_TEST_PCB_INTERVAL + 1);
+    CHECK(minPcbReadGapNs >= FUSION_TEST_PCB_INTERVAL);
+}
+
+//Threshold wakeups: stable at 45 oC the controller arms the SOC limits and
+//only polls the status every THRESHOLD_TEST_POLL. A spike shorter than one
+//poll still latches the status, so the next poll takes a full sample.
+#define THRESHOLD_TEST_POLL 120.0
+#define THRESHOLD_TEST_SPIKE_AT 900.0
+#define THRESHOLD_TEST_SPIKE_LENGTH 5.0
+
+static void ThresholdSpikeStep(SimState *state, u64 dtNs, void *user)
+{
+    (void)user;
+
+    double time_s = (state->timeNs + dtNs) / 1e9;
+    bool spike = time_s >= THRESHOLD_TEST_SPIKE_AT && time_s < THRESHOLD_TEST_SPIKE_AT + THRESHOLD_TEST_SPIKE_LENGTH;
+    state->socTemp = spike ? 52.0f : 45.0f;
+}
+
+typedef struct
+{
+    u64     cursor;
+    u32     armedSamples;
+    bool    armedAtSpike;       // The last sample before the spike left the limits armed
+    double  lastBeforeSpike_s;
+    double  firstAfterSpike_s;  // 0 if no sample followed
+    u32     statusReadsBeforeSpike;
+} ThresholdRecord;
+
+static void RecordThreshold(const SimState *state, u64 timeoutNs, void *user)
+{
+    (void)timeoutNs;
+
+    ThresholdRecord *record = (ThresholdRecord *)user;
+    FanControllerSample samples[FAN_TELEMETRY_RING_SIZE];
+    size_t count;
+
+    if (state && state->timeNs / 1e9 < THRESHOLD_TEST_SPIKE_AT)
+        record->statusReadsBeforeSpike = SimGetRegisterReads(SIM_REG_STATUS);
+
+    while ((count = FanControllerReadSamples(&record->cursor, samples, FAN_TELEMETRY_RING_SIZE)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            double time_s = (double)samples[i].tick / SIM_TICK_FREQUENCY;
+            bool armed = samples[i].flags & FAN_SAMPLE_FLAG_LIMITS_ARMED;
+
+            if (armed) {
+                record->armedSamples++;
+                CHECK(samples[i].sleepTime == (u64)(THRESHOLD_TEST_POLL * 1e9));
+            }
+            if (time_s < THRESHOLD_TEST_SPIKE_AT) {
+                record->lastBeforeSpike_s = time_s;
+                record->armedAtSpike = armed;
+            } else if (record->firstAfterSpike_s == 0) {
+                record->firstAfterSpike_s = time_s;
+            }
+        }
+    }
+}
+
+static void TestLimitCrossingWakesController()
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+    options.thresholdWakeups = true;
+
+    ThresholdRecord record = {0};
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, 1500000000000ULL);
+    SimSetStepFunction(ThresholdSpikeStep, 1000000000ULL, NULL);
+
+    FanControllerSample discarded[FAN_TELEMETRY_RING_SIZE];
+    while (FanControllerReadSamples(&record.cursor, discarded, FAN_TELEMETRY_RING_SIZE) > 0)
+        ;
+    SimSetSleepCallback(RecordThreshold, &record);
+
+    StartController(&options);
+    SimWaitFinished();
+    CloseFanControllerThread();
+    SimSetSleepCallback(NULL, NULL);
+    SimSetStepFunction(NULL, 0, NULL);
+
+    // Armed well before the spike, and only the status was read since
+    CHECK(record.armedSamples > 0);
+    CHECK(record.armedAtSpike);
+    CHECK(record.lastBeforeSpike_s + 2 * THRESHOLD_TEST_POLL < THRESHOLD_TEST_SPIKE_AT);
+    CHECK(record.statusReadsBeforeSpike >= 2);
+    CHECK(SimGetRegisterWrites(SIM_REG_SOC_HIGH_WRITE) > 0);
+
+    // The latched crossing disarmed the limits at the next poll, long after
+    // the spike itself had passed
+    CHECK(record.firstAfterSpike_s > THRESHOLD_TEST_SPIKE_AT + THRESHOLD_TEST_SPIKE_LENGTH);
+    CHECK(record.firstAfterSpike_s <= THRESHOLD_TEST_SPIKE_AT + THRESHOLD_TEST_POLL);
+}
+
+//Wall-clock variant of the simulated backend: the controller really blocks on
+//its wake event through the eventWait in switch_host.c, so how long shutdown
+//and curve updates take to reach a sleeping thread can be measured
+#define WAKE_LATENCY_LIMIT_NS 100000000ULL     // 100 ms
+
+static atomic_ullong wallWaitTimeoutNs;         // Timeout of the wait in progress, 0 while awake
+
+static u64 WallClockNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static u64 WallGetTick()
+{
+    return WallClockNs();
+}
+
+static u64 WallGetTickFrequency()
+{
+    return 1000000000ULL;
+}
+
+static void WallWaitForWakeup(Event *event, u64 timeoutNs)
+{
+    atomic_store(&wallWaitTimeoutNs, timeoutNs);
+    if (event) {
+        eventWait(event, timeoutNs);
+    } else {
+        svcSleepThread(timeoutNs);
+    }
+    atomic_store(&wallWaitTimeoutNs, 0);
+}
+
+static FanControllerBackend wallBackend;
+
+// Spins until the controller blocks in a wait of at least minTimeoutNs
+static bool WaitForLongSleep(u64 minTimeoutNs)
+{
+    u64 deadline = WallClockNs() + 2000000000ULL;
+    while (WallClockNs() < deadline) {
+        if (atomic_load(&wallWaitTimeoutNs) >= minTimeoutNs)
+            return true;
+        svcSleepThread(1000000);
+    }
+    return false;
+}
+
+static void StartWallClockController(bool inFocus)
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+
+    wallBackend = fanControllerDefaultBackend;
+    wallBackend.getTick = WallGetTick;
+    wallBackend.getTickFrequency = WallGetTickFrequency;
+    wallBackend.waitForWakeup = WallWaitForWakeup;
+    FanControllerSetBackend(&wallBackend);
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = inFocus };
+    SimInit(&initial, UINT64_MAX);
+    atomic_store(&wallWaitTimeoutNs, 0);
+
+    StartController(&options);
+}
+
+// In sleep mode the thread waits for 5 minutes, closing must not
+static void TestCloseWakesSleepingThread()
+{
+    StartWallClockController(false);
+    CHECK(WaitForLongSleep(60000000000ULL));
+
+    u64 start = WallClockNs();
+    CloseFanControllerThread();
+    u64 latency = WallClockNs() - start;
+
+    CHECK(latency < WAKE_LATENCY_LIMIT_NS);
+    FanControllerSetBackend(NULL);
+}
+
+// A new curve is applied at once, not after the stable interval runs out
+static void TestCurveUpdateWakesSleepingThread()
+{
+    static const TemperaturePoint loudTable[] =
+    {
+        { .temperature_c = 20, .fanLevel_f = 1.00 },
+        { .temperature_c = 70, .fanLevel_f = 1.00 }
+    };
+
+    StartWallClockController(true);
+    CHECK(WaitForLongSleep(NORMAL_TEST_INTERVAL));
+
+    SimState before;
+    SimGetState(&before);
+
+    u64 start = WallClockNs();
+    CHECK(FanControllerSetCurve(loudTable, 2));
+
+    SimState after = before;
+    while (after.fanLevel == before.fanLevel && WallClockNs() - start < 2000000000ULL) {
+        svcSleepThread(1000000);
+        SimGetState(&after);
+    }
+    u64 latency = WallClockNs() - start;
+
+    CHECK(after.fanLevel > before.fanLevel);
+    CHECK(latency < WAKE_LATENCY_LIMIT_NS);
+
+    CloseFanControllerThread();
+    FanControllerSetBackend(NULL);
+}
+
+//Sensor trace: buffers are written by the log writer thread, so the file is
+//checked while the controller idles at the end of the run, before closing
+static bool WaitForTraceRecords()
+{
+    struct stat st;
+    u64 deadline = WallClockNs() + 2000000000ULL;
+
+    while (WallClockNs() < deadline) {
+        if (stat(TRACE_FILE, &st) == 0 && (size_t)st.st_size > sizeof(FanTraceHeader))
+            return true;
+        svcSleepThread(1000000);
+    }
+    return false;
+}
+
+static void RunTracedController(SimStepFunction step, u64 durationNs)
+{
+    FanControllerOptions options;
+    DefaultTestOptions(&options);
+    options.sensorTrace = true;
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, durationNs);
+    SimSetStepFunction(step, 1000000000ULL, NULL);
+    remove(TRACE_FILE);
+
+    StartController(&options);
+    SimWaitFinished();
+}
+
+// A quiet run fills nowhere near a buffer, the time bound hands it over
+static void TestTraceReachesStorageWhileQuiet()
+{
+    RunTracedController(NULL, 600000000000ULL);
+
+    CHECK(WaitForTraceRecords());
+    CloseFanControllerThread();
+    SimSetStepFunction(NULL, 0, NULL);
+}
+
+// Critical from 20 s, ending well before the time bound
+static void EarlyCriticalStep(SimState *state, u64 dtNs, void *user)
+{
+    (void)user;
+    state->socTemp = state->timeNs + dtNs > 20000000000ULL ? 92.0f : 45.0f;
+}
+
+static void TestTraceReachesStorageOnEmergency()
+{
+    RunTracedController(EarlyCriticalStep, 45000000000ULL);
+
+    CHECK(WaitForTraceRecords());
+    CloseFanControllerThread();
+    SimSetStepFunction(NULL, 0, NULL);
+}
+
+int main()
+{
+    CheckEnterScratchDir();
+
+    RUN_TEST(TestConversionRateFollowsInterval);
+    RUN_TEST(TestLogStartsAtInit);
+    RUN_TEST(TestEmergencyIgnoresFilterLag);
+    RUN_TEST(TestLoadStepIsNotStall);
+    RUN_TEST(TestStalledFanForcedToFullSpeed);
+    RUN_TEST(TestStallCaughtOnSlopedCurve);
+    RUN_TEST(TestFusionFollowsSlowPcb);
+    RUN_TEST(TestLimitCrossingWakesController);
+    RUN_TEST(TestCloseWakesSleepingThread);
+    RUN_TEST(TestCurveUpdateWakesSleepingThread);
+    RUN_TEST(TestTraceReachesStorageWhileQuiet);
+    RUN_TEST(TestTraceReachesStorageOnEmergency);
+
+    CheckLeaveScratchDir();
+    return CheckExit();
+}
@@ -0,0 +1,148 @@
+//Curve publishing under load: readers evaluate the SOC curve while the main
+//thread swaps between two flat curves of different lengths. The controller
+//source is included, like the bench does, to reach the reader pin directly.
+#include "../source/fancontrol.c"
+
+#include <pthread.h>
+
+#include "check.h"
+
+#define SWAP_STREAM_READERS 2
+#define SWAP_HOLDING_READERS 2
+#define SWAP_READERS (SWAP_STREAM_READERS + SWAP_HOLDING_READERS)
+#define SWAP_PUBLISHES 600
+
+static const float quietLevel = 0.2f;
+static const float loudLevel = 0.8f;
+
+static TemperaturePoint quietTable[FAN_CURVE_MIN_POINTS];
+static TemperaturePoint loudTable[FAN_CURVE_MAX_POINTS];
+
+static atomic_bool swapStop;
+
+typedef struct
+{
+    pthread_t   thread;
+    u64         evaluations;
+    u64         mismatches;
+    float       badLevel;       // First level that didn't belong to a whole curve
+} SwapReader;
+
+// Both curves are flat between their first and last points, so any temperature
+// from 21 to 99 oC interpolates between equal entries and is exact. Readers
+// sample halfway between LUT entries, where a torn slot would show as a blend.
+static void BuildTables()
+{
+    quietTable[0] = (TemperaturePoint) { .temperature_c = 20, .fanLevel_f = quietLevel };
+    quietTable[1] = (TemperaturePoint) { .temperature_c = 100, .fanLevel_f = quietLevel };
+
+    for (int i = 0; i < FAN_CURVE_MAX_POINTS; i++) {
+        loudTable[i] = (TemperaturePoint) { .temperature_c = 20 + 2 * i, .fanLevel_f = loudLevel };
+    }
+}
+
+static float SwapTemperature(u32 step)
+{
+    return 21.0f + ((step % (78 * 16)) + 0.5f) / 16.0f;
+}
+
+static void SwapMismatch(SwapReader *reader, float level)
+{
+    if (reader->mismatches == 0)
+        reader->badLevel = level;
+    reader->mismatches++;
+}
+
+// The controller's own path, as fast as it goes
+static void *SwapStreamReader(void *arg)
+{
+    SwapReader *reader = (SwapReader *)arg;
+    u32 step = 0;
+
+    while (!atomic_load_explicit(&swapStop, memory_order_relaxed)) {
+        float level = CalculateFanLevel(SwapTemperature(step++));
+
+        if (level != quietLevel && level != loudLevel)
+            SwapMismatch(reader, level);
+        reader->evaluations++;
+    }
+
+    return NULL;
+}
+
+// Keeps a slot pinned across a yield, giving publishers every chance to
+// recompile it underneath. It must read the same curve before and after.
+static void *SwapHoldingReader(void *arg)
+{
+    SwapReader *reader = (SwapReader *)arg;
+    u32 step = 0;
+
+    while (!atomic_load_explicit(&swapStop, memory_order_relaxed)) {
+        const CompiledFanCurve *curve = AcquireFanCurve(FanCurveSensor_Soc);
+        float temperature = SwapTemperature(step++);
+        float before = LookupFanLevel(curve, temperature);
+        u32 pointCount = curve->pointCount;
+
+        svcSleepThread(0);
+
+        float after = LookupFanLevel(curve, temperature);
+        float expected = pointCount == FAN_CURVE_MIN_POINTS ? quietLevel : loudLevel;
+        if (before != expected || after != expected || curve->pointCount != pointCount)
+            SwapMismatch(reader, after);
+
+        ReleaseFanCurve(FanCurveSensor_Soc, curve);
+        reader->evaluations++;
+    }
+
+    return NULL;
+}
+
+static void TestSwapWhileEvaluating()
+{
+    SwapReader readers[SWAP_READERS] = {0};
+
+    BuildTables();
+    CHECK(FanControllerSetCurve(quietTable, FAN_CURVE_MIN_POINTS));
+    atomic_store(&swapStop, false);
+
+    for (int i = 0; i < SWAP_READERS; i++) {
+        void *(*entry)(void *) = i < SWAP_STREAM_READERS ? SwapStreamReader : SwapHoldingReader;
+        CHECK(pthread_create(&readers[i].thread, NULL, entry, &readers[i]) == 0);
+    }
+
+    // Slots alternate on every publish, so a period of three makes each slot
+    // change curve; with a period of two a recompile would rewrite the same one
+    u32 failedPublishes = 0;
+    for (int n = 1; n <= SWAP_PUBLISHES; n++) {
+        bool published = (n % 3) ? FanControllerSetCurve(quietTable, FAN_CURVE_MIN_POINTS)
+                                 : FanControllerSetCurve(loudTable, FAN_CURVE_MAX_POINTS);
+        if (!published)
+            failedPublishes++;
+    }
+
+    atomic_store(&swapStop, true);
+
+    for (int i = 0; i < SWAP_READERS; i++) {
+        pthread_join(readers[i].thread, NULL);
+
+        CHECK(readers[i].evaluations > 0);
+        CHECK_EQ(readers[i].mismatches, 0);
+        if (readers[i].mismatches)
+            fprintf(stderr, "reader %d: %llu bad evaluations, first %f\n", i,
+                    (unsigned long long)readers[i].mismatches, readers[i].badLevel);
+    }
+
+    CHECK_EQ(failedPublishes, 0);
+
+    // Every pin was released, and the last publish is the one in effect
+    CHECK_EQ(atomic_load(&fanCurveReaders[FanCurveSensor_Soc][0]), 0);
+    CHECK_EQ(atomic_load(&fanCurveReaders[FanCurveSensor_Soc][1]), 0);
+    CHECK(CalculateFanLevel(50.0f) == ((SWAP_PUBLISHES % 3) ? quietLevel : loudLevel));
+}
+
+int main()
+{
+    RUN_TEST(TestSwapWhileEvaluating);
+
+    return CheckExit();
+}
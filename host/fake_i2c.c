@@ -0,0 +1,165 @@
+#include <string.h>
+
+#include "fake_i2c.h"
+
+#define FAKE_I2C_DEVICES 32
+
+//Command byte layout of the I2C service's command lists
+#define FAKE_I2C_COMMAND_SEND    0
+#define FAKE_I2C_COMMAND_RECEIVE 1
+#define FAKE_I2C_COMMAND_MASK    0x3F
+
+static u8 fakeRegisters[FAKE_I2C_DEVICES][256];
+static u8 fakePointers[FAKE_I2C_DEVICES];
+static bool fakeSessionOpen[FAKE_I2C_MAX_SESSIONS + 1];    // Indexed by session id, 0 is unused
+static FakeI2cStats fakeStats;
+static Result fakeOpenError;
+static Result fakeCommandListError;
+
+static Result FakeI2cBadInput()
+{
+    fakeStats.invalidCalls++;
+    return MAKERESULT(Module_Libnx, LibnxError_BadInput);
+}
+
+void FakeI2cReset()
+{
+    memset(fakeRegisters, 0, sizeof(fakeRegisters));
+    memset(fakePointers, 0, sizeof(fakePointers));
+    memset(fakeSessionOpen, 0, sizeof(fakeSessionOpen));
+    memset(&fakeStats, 0, sizeof(fakeStats));
+    fakeOpenError = 0;
+    fakeCommandListError = 0;
+}
+
+void FakeI2cSetRegister(I2cDevice dev, u8 reg, u8 val)
+{
+    fakeRegisters[dev % FAKE_I2C_DEVICES][reg] = val;
+}
+
+u8 FakeI2cGetRegister(I2cDevice dev, u8 reg)
+{
+    return fakeRegisters[dev % FAKE_I2C_DEVICES][reg];
+}
+
+void FakeI2cFailNextOpen(Result rc)
+{
+    fakeOpenError = rc;
+}
+
+void FakeI2cFailNextCommandList(Result rc)
+{
+    fakeCommandListError = rc;
+}
+
+void FakeI2cGetStats(FakeI2cStats *out)
+{
+    *out = fakeStats;
+}
+
+Result i2cOpenSession(I2cSession *out, I2cDevice dev)
+{
+    fakeStats.opens++;
+
+    if (R_FAILED(fakeOpenError)) {
+        Result rc = fakeOpenError;
+        fakeOpenError = 0;
+        return rc;
+    }
+
+    for (u32 id = 1; id <= FAKE_I2C_MAX_SESSIONS; id++) {
+        if (!fakeSessionOpen[id]) {
+            fakeSessionOpen[id] = true;
+            fakeStats.openSessions++;
+            out->dev = dev;
+            out->id = id;
+            return 0;
+        }
+    }
+
+    return MAKERESULT(Module_Libnx, LibnxError_OutOfMemory);
+}
+
+void i2csessionClose(I2cSession *s)
+{
+    fakeStats.closes++;
+
+    if (s->id == 0 || s->id > FAKE_I2C_MAX_SESSIONS || !fakeSessionOpen[s->id]) {
+        fakeStats.invalidCalls++;
+        return;
+    }
+
+    fakeSessionOpen[s->id] = false;
+    fakeStats.openSessions--;
+    s->id = 0;
+}
+
+// A send's first byte moves the register pointer, further bytes are written
+// from there on; a receive reads from the pointer. Both advance it.
+Result i2csessionExecuteCommandList(I2cSession *s, void *dst, size_t dst_size, const void *cmdlist, size_t cmdlist_size)
+{
+    fakeStats.commandLists++;
+
+    if (s->id == 0 || s->id > FAKE_I2C_MAX_SESSIONS || !fakeSessionOpen[s->id])
+        return FakeI2cBadInput();
+
+    if (R_FAILED(fakeCommandListError)) {
+        Result rc = fakeCommandListError;
+        fakeCommandListError = 0;
+        return rc;
+    }
+
+    const u8 *cmd = (const u8 *)cmdlist;
+    const u8 *end = cmd + cmdlist_size;
+    u8 *out = (u8 *)dst;
+    size_t received = 0;
+    u8 *registers = fakeRegisters[s->dev % FAKE_I2C_DEVICES];
+    u8 *pointer = &fakePointers[s->dev % FAKE_I2C_DEVICES];
+
+    // Validate the whole list first, the service rejects it before touching the bus
+    for (const u8 *pos = cmd; pos < end; ) {
+        if (end - pos < 2)
+            return FakeI2cBadInput();
+
+        u8 command = pos[0] & FAKE_I2C_COMMAND_MASK;
+        u8 length = pos[1];
+
+        if (command == FAKE_I2C_COMMAND_SEND) {
+            if (length == 0 || end - pos < 2 + length)
+                return FakeI2cBadInput();
+            pos += 2 + length;
+        } else if (command == FAKE_I2C_COMMAND_RECEIVE) {
+            if (length == 0)
+                return FakeI2cBadInput();
+            received += length;
+            pos += 2;
+        } else {
+            return FakeI2cBadInput();
+        }
+    }
+
+    if (received != dst_size || (received > 0 && !dst))
+        return FakeI2cBadInput();
+
+    while (cmd < end) {
+        u8 command = cmd[0] & FAKE_I2C_COMMAND_MASK;
+        u8 length = cmd[1];
+
+        if (command == FAKE_I2C_COMMAND_SEND) {
+            fakeStats.sends++;
+            *pointer = cmd[2];
+            for (u8 i = 1; i < length; i++) {
+                registers[(*pointer)++] = cmd[2 + i];
+            }
+            cmd += 2 + length;
+        } else {
+            fakeStats.receives++;
+            for (u8 i = 0; i < length; i++) {
+                *out++ = registers[(*pointer)++];
+            }
+            cmd += 2;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <switch.h>
+
+//Scripted I2C service for the host tests: every device is a 256-byte register
+//file behind a register pointer, as on a TMP451. Command lists are decoded
+//like the real service does, so packing mistakes in include/i2c.h show up as
+//wrong values or rejected lists. Every IPC call is counted.
+
+#define FAKE_I2C_MAX_SESSIONS 8
+
+typedef struct
+{
+    u32     opens;              // i2cOpenSession calls, failed ones included
+    u32     closes;
+    u32     commandLists;       // i2csessionExecuteCommandList calls, one bus transaction each
+    u32     openSessions;       // Currently open
+    u32     invalidCalls;       // Calls on a session that wasn't open, or malformed lists
+    u32     sends;              // Send commands across all lists
+    u32     receives;           // Receive commands across all lists
+} FakeI2cStats;
+
+// Clears every register, session and counter
+void FakeI2cReset();
+
+void FakeI2cSetRegister(I2cDevice dev, u8 reg, u8 val);
+u8 FakeI2cGetRegister(I2cDevice dev, u8 reg);
+
+// The next open or command list fails with rc, once
+void FakeI2cFailNextOpen(Result rc);
+void FakeI2cFailNextCommandList(Result rc);
+
+void FakeI2cGetStats(FakeI2cStats *out);
@@ -0,0 +1,520 @@
+//Micro-benchmarks for the controller's hot paths on the host. The controller
+//source is included rather than linked so the adaptive sleep benchmark can
+//carry lastTemperature and friends between calls the way the thread does.
+#include "../source/fancontrol.c"
+
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "sim.h"
+
+//Allocation counting: these override glibc's allocator entry points for the
+//whole process, stdio's buffers and the contended cases' threads included,
+//and forward to the real ones
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static atomic_ullong benchAllocations;
+static atomic_ullong benchAllocatedBytes;
+
+static void BenchCountAllocation(size_t size)
+{
+    atomic_fetch_add_explicit(&benchAllocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&benchAllocatedBytes, size, memory_order_relaxed);
+}
+
+void *malloc(size_t size)
+{
+    BenchCountAllocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    BenchCountAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    BenchCountAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+//Slow storage: while set, every fwrite stalls first, like an SD card busy
+//erasing. Only the log writer thread writes while the slow cases run.
+#define BENCH_SLOW_SINK_NS 5000000ULL   // 5 ms per write
+
+extern size_t _IO_fwrite(const void *ptr, size_t size, size_t count, FILE *stream);
+
+static atomic_bool benchSlowSink;
+
+size_t fwrite(const void *ptr, size_t size, size_t count, FILE *stream)
+{
+    if (atomic_load_explicit(&benchSlowSink, memory_order_relaxed))
+        svcSleepThread(BENCH_SLOW_SINK_NS);
+    return _IO_fwrite(ptr, size, count, stream);
+}
+
+#define BENCH_STREAM_LENGTH 4096
+
+typedef struct
+{
+    const char *name;
+    void      (*run)(u64 iterations);
+    u64         opsPerIteration;    // Operations reported per call of run's loop body
+} Benchmark;
+
+typedef struct
+{
+    double  nsPerOp;
+    u64     maxNs;          // Slowest single op, for cases that time each one
+    double  allocsPerOp;
+    double  bytesPerOp;
+    u64     ops;
+} BenchmarkResult;
+
+static u64 benchMaxNs;
+static volatile float benchSinkFloat;
+static volatile u64 benchSinkU64;
+
+//Background threads for the contended cases, started and joined by each run
+#define BENCH_MAX_THREADS 4
+#define BENCH_TELEMETRY_READERS 4
+
+static pthread_t benchThreads[BENCH_MAX_THREADS];
+static int benchThreadCount;
+static atomic_bool benchThreadsStop;
+
+static float benchTemperatureStream[BENCH_STREAM_LENGTH];
+static u8 benchRawStream[BENCH_STREAM_LENGTH][2];
+
+static u64 BenchNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Slow thermal swings with sensor-sized steps and occasional load jumps,
+// from a fixed seed so every run sees the same stream
+static void BenchInitStreams()
+{
+    u32 seed = 0x2545F491;
+    float temperature = 45.0f;
+
+    for (int i = 0; i < BENCH_STREAM_LENGTH; i++) {
+        seed = seed * 1664525 + 1013904223;
+        float noise = (float)((seed >> 8) & 0xFF) / 255.0f - 0.5f;
+
+        temperature += 0.5f * sinf(i * 0.01f) + noise * 0.25f;
+        if ((seed >> 28) == 0)
+            temperature += noise * 20.0f;
+        temperature = fminf(fmaxf(temperature, 20.0f), 95.0f);
+
+        benchTemperatureStream[i] = roundf(temperature * 16.0f) / 16.0f;
+        benchRawStream[i][0] = (u8)temperature;
+        benchRawStream[i][1] = (u8)(((int)(temperature * 16.0f) & 0xF) << 4);
+    }
+}
+
+// Every 1/64 oC from -10 to 130 oC, past both ends of the LUT
+#define FAN_LEVEL_SWEEP_STEPS (140 * 64 + 1)
+
+static void BenchFanLevelSweep(u64 iterations)
+{
+    float sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        for (int i = 0; i < FAN_LEVEL_SWEEP_STEPS; i++) {
+            sum += CalculateFanLevel(-10.0f + i / 64.0f);
+        }
+    }
+    benchSinkFloat = sum;
+}
+
+// The same sweep on the active curve without pinning it: the LUT lookup alone,
+// then the segment walk the LUT is built from
+static void BenchFanCurveLookupSweep(u64 iterations)
+{
+    const CompiledFanCurve *curve = atomic_load(&activeFanCurves[FanCurveSensor_Soc]);
+    float sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        for (int i = 0; i < FAN_LEVEL_SWEEP_STEPS; i++) {
+            sum += LookupFanLevel(curve, -10.0f + i / 64.0f);
+        }
+    }
+    benchSinkFloat = sum;
+}
+
+static void BenchFanCurveEvaluateSweep(u64 iterations)
+{
+    const CompiledFanCurve *curve = atomic_load(&activeFanCurves[FanCurveSensor_Soc]);
+    float sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        for (int i = 0; i < FAN_LEVEL_SWEEP_STEPS; i++) {
+            sum += EvaluateFanCurve(curve, -10.0f + i / 64.0f);
+        }
+    }
+    benchSinkFloat = sum;
+}
+
+static void BenchFanLevelStream(u64 iterations)
+{
+    float sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        sum += CalculateFanLevel(benchTemperatureStream[n % BENCH_STREAM_LENGTH]);
+    }
+    benchSinkFloat = sum;
+}
+
+// Mirrors the thread: the previous sample feeds the stability check
+static void BenchAdaptiveSleepStream(u64 iterations)
+{
+    u64 sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        float temperature = benchTemperatureStream[n % BENCH_STREAM_LENGTH];
+        float fanLevel = CalculateFanLevel(temperature);
+
+        sum += CalculateAdaptiveSleepTime(temperature, temperature, fanLevel);
+        lastTemperature = temperature;
+        lastFanLevel = fanLevel;
+    }
+    benchSinkU64 = sum;
+}
+
+static void BenchTmp451Decode(u64 iterations)
+{
+    float sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        const u8 *raw = benchRawStream[n % BENCH_STREAM_LENGTH];
+        sum += Tmp451DecodeTemp(raw[0], raw[1]);
+    }
+    benchSinkFloat = sum;
+}
+
+// Register batch, decode and timestamp through the simulated bus
+static void BenchTmp451Snapshot(u64 iterations)
+{
+    Tmp451Snapshot snapshot;
+    float sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        Tmp451GetSnapshot(&snapshot);
+        sum += snapshot.socTemp;
+    }
+    benchSinkFloat = sum;
+}
+
+static void BenchStartThread(void *(*entry)(void *))
+{
+    if (benchThreadCount == 0)
+        atomic_store(&benchThreadsStop, false);
+    if (benchThreadCount < BENCH_MAX_THREADS &&
+        pthread_create(&benchThreads[benchThreadCount], NULL, entry, NULL) == 0)
+        benchThreadCount++;
+}
+
+static void BenchStopThreads()
+{
+    atomic_store(&benchThreadsStop, true);
+    while (benchThreadCount > 0) {
+        pthread_join(benchThreads[--benchThreadCount], NULL);
+    }
+}
+
+// An overlay polling the ring: reads whatever is new, spins when caught up
+static void *BenchTelemetryReader(void *arg)
+{
+    (void)arg;
+    FanControllerSample samples[16];
+    u64 cursor = 0;
+    u64 sum = 0;
+
+    while (!atomic_load_explicit(&benchThreadsStop, memory_order_relaxed)) {
+        sum += FanControllerReadSamples(&cursor, samples, 16);
+    }
+    benchSinkU64 = sum;
+    return NULL;
+}
+
+static void *BenchTelemetryPublisher(void *arg)
+{
+    (void)arg;
+    FanControllerSample sample = { .socTemp = 45.0f, .pcbTemp = 35.0f, .fanLevel = 0.55f };
+
+    while (!atomic_load_explicit(&benchThreadsStop, memory_order_relaxed)) {
+        sample.tick++;
+        PublishSample(&sample);
+    }
+    return NULL;
+}
+
+static void BenchTelemetryPublishLoop(u64 iterations)
+{
+    FanControllerSample sample = { .socTemp = 45.0f, .pcbTemp = 35.0f, .fanLevel = 0.55f };
+    for (u64 n = 0; n < iterations; n++) {
+        sample.tick = n;
+        PublishSample(&sample);
+    }
+}
+
+static void BenchTelemetryPublish(u64 iterations)
+{
+    BenchTelemetryPublishLoop(iterations);
+}
+
+// The controller's side while overlays poll the ring on other threads
+static void BenchTelemetryPublishContended(u64 iterations)
+{
+    for (int i = 0; i < BENCH_TELEMETRY_READERS; i++) {
+        BenchStartThread(BenchTelemetryReader);
+    }
+    BenchTelemetryPublishLoop(iterations);
+    BenchStopThreads();
+}
+
+// One reader copying the whole ring while it is being overwritten and three
+// more readers compete; reported per slot, torn slots included
+static void BenchTelemetryReadContended(u64 iterations)
+{
+    FanControllerSample samples[FAN_TELEMETRY_RING_SIZE];
+    u64 sum = 0;
+
+    BenchStartThread(BenchTelemetryPublisher);
+    for (int i = 1; i < BENCH_TELEMETRY_READERS; i++) {
+        BenchStartThread(BenchTelemetryReader);
+    }
+
+    for (u64 n = 0; n < iterations; n++) {
+        u64 cursor = 0; // Clamped to the oldest sample still in the ring
+        sum += FanControllerReadSamples(&cursor, samples, FAN_TELEMETRY_RING_SIZE);
+    }
+
+    BenchStopThreads();
+    benchSinkU64 = sum;
+}
+
+// The controller's log calls with the writer running, each one timed. With a
+// slow sink the queue fills and they take the drop path, which must stay just
+// as short as a normal enqueue.
+static void BenchLogEnqueueLoop(u64 iterations, u32 flags, bool slowSink)
+{
+    FanControllerSample sample = { .socTemp = 45.0f, .pcbTemp = 35.0f, .fanLevel = 0.55f, .flags = flags };
+
+    InitLogWriter();
+    atomic_store(&benchSlowSink, slowSink);
+
+    for (u64 n = 0; n < iterations; n++) {
+        sample.tick = n;
+        u64 start = BenchNow();
+        LogSample(&sample);
+        u64 elapsed = BenchNow() - start;
+
+        if (elapsed > benchMaxNs)
+            benchMaxNs = elapsed;
+    }
+
+    atomic_store(&benchSlowSink, false);
+    CloseLogWriter();
+}
+
+// Baseline for the max: on a host with few cores it is mostly preemption
+static void BenchLogEnqueue(u64 iterations)
+{
+    BenchLogEnqueueLoop(iterations, 0, false);
+}
+
+static void BenchLogEnqueueSlowSink(u64 iterations)
+{
+    BenchLogEnqueueLoop(iterations, 0, true);
+}
+
+// Every sample asks for an immediate flush, so every call signals the writer
+static void BenchLogEnqueueSlowEmergency(u64 iterations)
+{
+    BenchLogEnqueueLoop(iterations, FAN_SAMPLE_FLAG_EMERGENCY, true);
+}
+
+static void BenchConfigRoundTrip(u64 iterations)
+{
+    TemperaturePoint table[FAN_CURVE_MAX_POINTS];
+    for (u32 i = 0; i < FAN_CURVE_MAX_POINTS; i++) {
+        table[i].temperature_c = 20 + i;
+        table[i].fanLevel_f = (float)i / (FAN_CURVE_MAX_POINTS - 1);
+    }
+
+    u32 sum = 0;
+    for (u64 n = 0; n < iterations; n++) {
+        TemperaturePoint *loaded;
+        u32 pointCount;
+
+        WriteConfigFile(table, FAN_CURVE_MAX_POINTS);
+        ReadConfigFile(&loaded, &pointCount);
+        sum += pointCount;
+        free(loaded);
+    }
+    benchSinkU64 = sum;
+}
+
+static const Benchmark benchmarks[] =
+{
+    { "fan_level_sweep",             BenchFanLevelSweep,             FAN_LEVEL_SWEEP_STEPS },
+    { "fan_curve_lookup_sweep",      BenchFanCurveLookupSweep,       FAN_LEVEL_SWEEP_STEPS },
+    { "fan_curve_evaluate_sweep",    BenchFanCurveEvaluateSweep,     FAN_LEVEL_SWEEP_STEPS },
+    { "fan_level_stream",            BenchFanLevelStream,            1 },
+    { "adaptive_sleep_stream",       BenchAdaptiveSleepStream,       1 },
+    { "tmp451_decode",               BenchTmp451Decode,              1 },
+    { "tmp451_snapshot_sim",         BenchTmp451Snapshot,            1 },
+    { "config_round_trip",           BenchConfigRoundTrip,           1 },
+    { "telemetry_publish",           BenchTelemetryPublish,          1 },
+    { "telemetry_publish_4_readers", BenchTelemetryPublishContended, 1 },
+    { "telemetry_read_contended",    BenchTelemetryReadContended,    FAN_TELEMETRY_RING_SIZE },
+    { "log_enqueue",                 BenchLogEnqueue,                1 },
+    { "log_enqueue_slow_sink",       BenchLogEnqueueSlowSink,        1 },
+    { "log_enqueue_slow_emergency",  BenchLogEnqueueSlowEmergency,   1 },
+};
+
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// Doubles the iteration count until one run takes at least minNs
+static BenchmarkResult RunBenchmark(const Benchmark *benchmark, u64 minNs)
+{
+    BenchmarkResult result = {0};
+    u64 iterations = 1;
+
+    benchmark->run(1); // Warm caches and lazy allocations
+
+    while (true) {
+        benchMaxNs = 0;
+        u64 allocations = atomic_load(&benchAllocations);
+        u64 bytes = atomic_load(&benchAllocatedBytes);
+        u64 start = BenchNow();
+        benchmark->run(iterations);
+        u64 elapsed = BenchNow() - start;
+
+        if (elapsed >= minNs || iterations >= (1ULL << 40)) {
+            result.ops = iterations * benchmark->opsPerIteration;
+            result.nsPerOp = (double)elapsed / result.ops;
+            result.maxNs = benchMaxNs;
+            result.allocsPerOp = (double)(atomic_load(&benchAllocations) - allocations) / result.ops;
+            result.bytesPerOp = (double)(atomic_load(&benchAllocatedBytes) - bytes) / result.ops;
+            return result;
+        }
+        iterations *= 2;
+    }
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-t ms] [-f text|json|csv] [name...]\n"
+            "  -t  minimum measured time per benchmark (default 200)\n"
+            "  -f  output format (default text)\n"
+            "  names select benchmarks by prefix, default all\n",
+            name);
+}
+
+static bool BenchmarkSelected(const Benchmark *benchmark, int argc, char *argv[])
+{
+    if (optind >= argc)
+        return true;
+
+    for (int i = optind; i < argc; i++) {
+        if (strncmp(benchmark->name, argv[i], strlen(argv[i])) == 0)
+            return true;
+    }
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    u64 minNs = 200000000ULL;
+    const char *format = "text";
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:f:h")) != -1) {
+        switch (opt) {
+            case 't': minNs = (u64)(atof(optarg) * 1e6); break;
+            case 'f': format = optarg; break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    bool json = strcmp(format, "json") == 0;
+    bool csv = strcmp(format, "csv") == 0;
+    if (!json && !csv && strcmp(format, "text") != 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    // Config and log files land in a scratch directory, not the caller's
+    char scratch[] = "/tmp/fancontrol-bench-XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        fprintf(stderr, "Can't create a scratch directory\n");
+        return 1;
+    }
+
+    BenchInitStreams();
+    GetDefaultFanControllerOptions(&fanControllerOptions);
+    FanControllerSetCurve(defaultTable, DEFAULT_POINT_COUNT);
+
+    SimState initial = { .socTemp = 45.0f, .pcbTemp = 35.0f, .inFocus = true };
+    SimInit(&initial, UINT64_MAX);
+
+    if (json)
+        printf("[");
+    else if (csv)
+        printf("name,ns_per_op,max_ns,allocs_per_op,bytes_per_op,ops\n");
+    else
+        printf("%-28s %12s %12s %14s %14s %14s\n", "benchmark", "ns/op", "max ns", "allocs/op", "bytes/op", "ops");
+
+    bool first = true;
+    for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+        if (!BenchmarkSelected(&benchmarks[i], argc, argv))
+            continue;
+
+        BenchmarkResult result = RunBenchmark(&benchmarks[i], minNs);
+
+        // Cases that don't time single ops report a max of 0, shown as "-"
+        char maxText[24] = "-";
+        if (result.maxNs)
+            snprintf(maxText, sizeof(maxText), "%llu", (unsigned long long)result.maxNs);
+
+        if (json) {
+            printf("%s\n  {\"name\": \"%s\", \"ns_per_op\": %.3f, \"max_ns\": %llu, \"allocs_per_op\": %.4f, \"bytes_per_op\": %.1f, \"ops\": %llu}",
+                   first ? "" : ",", benchmarks[i].name, result.nsPerOp, (unsigned long long)result.maxNs,
+                   result.allocsPerOp, result.bytesPerOp, (unsigned long long)result.ops);
+        } else if (csv) {
+            printf("%s,%.3f,%llu,%.4f,%.1f,%llu\n", benchmarks[i].name, result.nsPerOp, (unsigned long long)result.maxNs,
+                   result.allocsPerOp, result.bytesPerOp, (unsigned long long)result.ops);
+        } else {
+            printf("%-28s %12.2f %12s %14.4f %14.1f %14llu\n", benchmarks[i].name, result.nsPerOp, maxText,
+                   result.allocsPerOp, result.bytesPerOp, (unsigned long long)result.ops);
+        }
+        fflush(stdout);
+        first = false;
+    }
+
+    if (json)
+        printf("\n]\n");
+
+    // Leave nothing behind in the scratch directory
+    remove(CONFIG_FILE);
+    remove(LOG_FILE);
+    remove(LOG_TEXT_FILE);
+    rmdir(CONFIG_DIR);
+    rmdir("./config");
+    if (chdir("/") == 0)
+        rmdir(scratch);
+
+    return 0;
+}
@@ -0,0 +1,740 @@
+#include <getopt.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fancontrol.h"
+#include "sim.h"
+#include "thermal_model.h"
+#include "trace_replay.h"
+
+//Runs the controller against the simulated backend with the RC thermal model
+//heating the SoC, or replaying a recorded sensor trace, prints every sample
+//as CSV and a summary on stderr. Time is virtual, so an hour of play takes
+//milliseconds. With --compare the same input runs twice, once with the
+//default options and once as configured, and a table of metrics is printed
+//instead of the samples.
+
+// Built-in default curve. ReadConfigFile isn't used because it creates
+// config files under the working directory.
+static const TemperaturePoint simTable[] =
+{
+    { .temperature_c = 20, .fanLevel_f = 0.10 },
+    { .temperature_c = 35, .fanLevel_f = 0.35 },
+    { .temperature_c = 45, .fanLevel_f = 0.55 },
+    { .temperature_c = 55, .fanLevel_f = 0.75 },
+    { .temperature_c = 70, .fanLevel_f = 1.00 }
+};
+
+// Idle in the menu, a long docked session, a break, then a heavier game
+static const HeatProfilePoint defaultProfile[] =
+{
+    { .time_s = 0,    .power_w = 3.0f },
+    { .time_s = 120,  .power_w = 10.0f },
+    { .time_s = 2520, .power_w = 5.0f },
+    { .time_s = 2820, .power_w = 12.0f },
+};
+
+#define SIM_MODEL_STEP 100000000ULL // 100 ms, well under the SoC time constant
+#define SIM_SETTLE_BAND 1.0f        // oC around the final temperature that counts as settled
+#define SIM_FINAL_SHARE 0.1         // Trailing share of the run averaged for the final temperature
+#define SIM_SHORT_SLEEP 1000000000ULL   // Ramp steps and emergencies sleep this long or less
+
+typedef struct
+{
+    double  time_s;
+    float   socTemp;
+    float   fanLevel;
+} SimTrajectoryPoint;
+
+typedef struct
+{
+    bool    printSamples;
+    u64     cursor;
+    u32     samples;
+    u32     fanWrites;
+    u32     shortSleeps;        // Samples followed by SIM_SHORT_SLEEP or less
+    u32     armedSamples;       // Samples that left the SoC limits armed
+    u32     alertWakeups;       // Full samples after armed ones, a limit crossed or the loop was woken
+    float   maxFanStep;         // Largest level change between two samples
+    float   peakSocTemp;
+    float   peakPcbTemp;
+    double  fanLevelSeconds;    // Integral of the fan level over time
+    double  lastTime_s;
+    float   lastFanLevel;
+    u32     lastFlags;
+    SimTrajectoryPoint *trajectory;     // Every sample, for the step response
+    u32     trajectoryCount;
+    u32     trajectoryCapacity;
+} SimSummary;
+
+//Input shared by every run: the plant or trace, the curve and the duration
+typedef struct
+{
+    double                  duration;
+    ThermalModelParameters  params;
+    const HeatProfilePoint *profile;
+    u32                     profileCount;
+    float                   stallAt;
+    const char             *replayPath;
+    const char             *curvePath;
+    const char             *pcbCurvePath;   // Published for fusion, none if NULL
+    double                  settleFrom_s;   // The step response is measured from here
+    float                   noise;          // Sensor noise sigma in oC
+    u32                     noiseSeed;
+} SimScenario;
+
+typedef struct
+{
+    SimSummary          summary;
+    FanControllerStats  stats;      // Counted during this run only
+    u32                 pcbReads;   // Of the PCB temperature register
+    double              wall_ms;
+} SimRun;
+
+static void RecordTrajectory(SimSummary *summary, double time_s, float socTemp, float fanLevel)
+{
+    if (summary->trajectoryCount == summary->trajectoryCapacity) {
+        u32 capacity = summary->trajectoryCapacity ? 2 * summary->trajectoryCapacity : 1024;
+        SimTrajectoryPoint *grown = realloc(summary->trajectory, capacity * sizeof(SimTrajectoryPoint));
+        if (!grown)
+            return;
+        summary->trajectory = grown;
+        summary->trajectoryCapacity = capacity;
+    }
+
+    summary->trajectory[summary->trajectoryCount++] = (SimTrajectoryPoint) {
+        .time_s = time_s,
+        .socTemp = socTemp,
+        .fanLevel = fanLevel,
+    };
+}
+
+// Drained on every sleep so the telemetry ring never laps the cursor. A sleep
+// with nothing to drain follows a status poll with the SoC limits armed, where
+// the plant stands in for the sample the controller didn't take.
+static void CollectSamples(const SimState *state, u64 timeoutNs, void *user)
+{
+    (void)timeoutNs;
+
+    SimSummary *summary = (SimSummary *)user;
+    FanControllerSample samples[FAN_TELEMETRY_RING_SIZE];
+    size_t count;
+    bool drained = false;
+
+    while ((count = FanControllerReadSamples(&summary->cursor, samples, FAN_TELEMETRY_RING_SIZE)) > 0) {
+        drained = true;
+        for (size_t i = 0; i < count; i++) {
+            const FanControllerSample *sample = &samples[i];
+            double time_s = (double)sample->tick / SIM_TICK_FREQUENCY;
+
+            if (summary->samples > 0)
+                summary->maxFanStep = fmaxf(summary->maxFanStep, fabsf(sample->fanLevel - summary->lastFanLevel));
+            if (sample->sleepTime <= SIM_SHORT_SLEEP)
+                summary->shortSleeps++;
+            if (sample->flags & FAN_SAMPLE_FLAG_LIMITS_ARMED)
+                summary->armedSamples++;
+            if (summary->lastFlags & FAN_SAMPLE_FLAG_LIMITS_ARMED)
+                summary->alertWakeups++;
+            summary->lastFlags = sample->flags;
+
+            summary->fanLevelSeconds += summary->lastFanLevel * (time_s - summary->lastTime_s);
+            summary->lastTime_s = time_s;
+            summary->lastFanLevel = sample->fanLevel;
+            summary->samples++;
+            if (sample->flags & FAN_SAMPLE_FLAG_FAN_WRITTEN)
+                summary->fanWrites++;
+            if (sample->socTemp > summary->peakSocTemp)
+                summary->peakSocTemp = sample->socTemp;
+            if (sample->pcbTemp > summary->peakPcbTemp)
+                summary->peakPcbTemp = sample->pcbTemp;
+            RecordTrajectory(summary, time_s, sample->socTemp, sample->fanLevel);
+
+            if (summary->printSamples) {
+                printf("%.3f,%.2f,%.2f,%.4f,0x%02x,%.3f\n",
+                       time_s, sample->socTemp, sample->pcbTemp, sample->fanLevel,
+                       sample->flags, (double)sample->sleepTime / 1e9);
+            }
+        }
+    }
+
+    if (state && !drained && (summary->lastFlags & FAN_SAMPLE_FLAG_LIMITS_ARMED))
+        RecordTrajectory(summary, state->timeNs / 1e9, state->socTemp, state->fanLevel);
+}
+
+static TemperaturePoint *LoadCurve(const char *path, u32 *pointCount)
+{
+    if (path) {
+        FILE *config = fopen(path, "rb");
+        if (!config)
+            return NULL;
+
+        TemperaturePoint *table = ReadConfigCurve(config, pointCount);
+        fclose(config);
+        return table;
+    }
+
+    TemperaturePoint *table = malloc(sizeof(simTable));
+    if (table) {
+        memcpy(table, simTable, sizeof(simTable));
+        *pointCount = sizeof(simTable) / sizeof(simTable[0]);
+    }
+    return table;
+}
+
+// The controller writes its logs under ./config, so the run happens in the log
+// directory. Paths given on the command line stay relative to where it started.
+static const char *AbsolutePath(const char *path, char *buffer, size_t size)
+{
+    char cwd[PATH_MAX];
+
+    if (!path || path[0] == '/' || !getcwd(cwd, sizeof(cwd)))
+        return path;
+
+    if (snprintf(buffer, size, "%s/%s", cwd, path) >= (int)size)
+        return path;
+    return buffer;
+}
+
+// A scratch directory unless -L named one, in which case the logs are kept
+static bool EnterLogDir(const char *logDir, char *scratch)
+{
+    if (logDir) {
+        mkdir(logDir, 0755);
+        return chdir(logDir) == 0;
+    }
+
+    return mkdtemp(scratch) && chdir(scratch) == 0;
+}
+
+static void LeaveScratchDir(const char *scratch)
+{
+    remove(LOG_FILE);
+    remove(LOG_TEXT_FILE);
+    remove(TRACE_FILE);
+    rmdir(LOG_DIR);
+    rmdir("./config");
+    if (chdir("/") == 0)
+        rmdir(scratch);
+}
+
+static void StatsSince(FanControllerStats *stats, const FanControllerStats *before)
+{
+    stats->loopIterations -= before->loopIterations;
+    stats->i2cTransactions -= before->i2cTransactions;
+    stats->i2cFailures -= before->i2cFailures;
+    stats->fanWrites -= before->fanWrites;
+    stats->fanWritesSkipped -= before->fanWritesSkipped;
+    for (int i = 0; i < FanSleepTier_Count; i++) {
+        stats->sleepTimeNs[i] -= before->sleepTimeNs[i];
+    }
+}
+
+// One controller run from init to close on a fresh plant or a rewound trace
+static bool RunSimulation(const SimScenario *scenario, const FanControllerOptions *options,
+                          const char *recordPath, SimRun *run)
+{
+    TraceReplay replay;
+    if (scenario->replayPath && !TraceReplayLoad(&replay, scenario->replayPath)) {
+        fprintf(stderr, "Invalid sensor trace: %s\n", scenario->replayPath);
+        return false;
+    }
+
+    // The controller takes ownership of the table and frees it on close
+    u32 pointCount = 0;
+    TemperaturePoint *table = LoadCurve(scenario->curvePath, &pointCount);
+    if (!table) {
+        fprintf(stderr, "Invalid fan curve: %s\n", scenario->curvePath ? scenario->curvePath : "(built-in)");
+        if (scenario->replayPath)
+            TraceReplayFree(&replay);
+        return false;
+    }
+
+    // Copied when published, and init doesn't carry it over from the last run
+    u32 pcbPointCount = 0;
+    TemperaturePoint *pcbTable = NULL;
+    if (scenario->pcbCurvePath) {
+        pcbTable = LoadCurve(scenario->pcbCurvePath, &pcbPointCount);
+        if (!pcbTable) {
+            fprintf(stderr, "Invalid PCB fan curve: %s\n", scenario->pcbCurvePath);
+            free(table);
+            if (scenario->replayPath)
+                TraceReplayFree(&replay);
+            return false;
+        }
+    }
+
+    SimSetSensorNoise(scenario->noise, scenario->noiseSeed);
+
+    ThermalModel model;
+    ThermalModelInit(&model, &scenario->params, scenario->profile, scenario->profileCount);
+    model.stallAt_s = scenario->stallAt;
+
+    SimState initial = { .inFocus = true };
+    if (scenario->replayPath) {
+        TraceReplayInitialState(&replay, &initial);
+        SimInit(&initial, (u64)(scenario->duration * 1e9));
+        SimSetStepFunction(TraceReplayStep, SIM_MODEL_STEP, &replay);
+    } else {
+        ThermalModelInitialState(&model, &initial);
+        SimInit(&initial, (u64)(scenario->duration * 1e9));
+        SimSetStepFunction(ThermalModelStep, SIM_MODEL_STEP, &model);
+    }
+
+    // Samples left in the ring by an earlier run belong to it
+    SimSummary *summary = &run->summary;
+    FanControllerSample discarded[FAN_TELEMETRY_RING_SIZE];
+    while (FanControllerReadSamples(&summary->cursor, discarded, FAN_TELEMETRY_RING_SIZE) > 0) {
+    }
+    SimSetSleepCallback(CollectSamples, summary);
+
+    FanControllerStats before;
+    FanControllerGetStats(&before);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    InitFanControllerWithOptions(table, pointCount, options);
+    if (pcbTable && !FanControllerSetPcbCurve(pcbTable, pcbPointCount)) {
+        fprintf(stderr, "Invalid PCB fan curve: %s\n", scenario->pcbCurvePath);
+    }
+    free(pcbTable);
+    if (recordPath && !FanTraceStart(recordPath)) {
+        fprintf(stderr, "Can't record sensor trace to %s\n", recordPath);
+    }
+    StartFanControllerThread();
+    SimWaitFinished();
+    CloseFanControllerThread();
+    FanTraceStop();
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    CollectSamples(NULL, 0, summary);
+    summary->fanLevelSeconds += summary->lastFanLevel * (scenario->duration - summary->lastTime_s);
+    SimSetSleepCallback(NULL, NULL);
+    SimSetStepFunction(NULL, 0, NULL);
+
+    run->wall_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    FanControllerGetStats(&run->stats);
+    StatsSince(&run->stats, &before);
+    run->pcbReads = SimGetRegisterReads(SIM_REG_PCB_TEMP);
+
+    if (scenario->replayPath)
+        TraceReplayFree(&replay);
+    return true;
+}
+
+static void PrintRunSummary(const SimScenario *scenario, const SimRun *run)
+{
+    static const char *tierNames[FanSleepTier_Count] = { "1s", "2s", "5s", "10s", "30s", "120s", "300s" };
+    const SimSummary *summary = &run->summary;
+    const FanControllerStats *stats = &run->stats;
+
+    fprintf(stderr, "simulated %.0f s in %.1f ms: %u samples, %u fan writes, peak SoC %.2f C, peak PCB %.2f C, mean fan %.1f%%\n",
+            scenario->duration, run->wall_ms, summary->samples, summary->fanWrites, summary->peakSocTemp,
+            summary->peakPcbTemp, 100.0 * summary->fanLevelSeconds / scenario->duration);
+    fprintf(stderr, "%llu iterations, %llu I2C transactions (%llu failed), %llu fan writes, %llu skipped\nasleep:",
+            (unsigned long long)stats->loopIterations, (unsigned long long)stats->i2cTransactions,
+            (unsigned long long)stats->i2cFailures, (unsigned long long)stats->fanWrites,
+            (unsigned long long)stats->fanWritesSkipped);
+    for (int i = 0; i < FanSleepTier_Count; i++) {
+        fprintf(stderr, " %s %.0f s", tierNames[i], stats->sleepTimeNs[i] / 1e9);
+    }
+    fprintf(stderr, "\n");
+}
+
+//Step response after scenario->settleFrom_s, against the mean temperature
+//over the last SIM_FINAL_SHARE of the run
+typedef struct
+{
+    float   peakTemp;
+    float   fanAtPeak;      // Level commanded at the hottest sample
+    float   finalTemp;
+    float   overshoot;      // Peak above the final temperature
+    double  settling_s;     // Until the SoC stays within SIM_SETTLE_BAND of it
+} SimStepResponse;
+
+static void MeasureStepResponse(const SimScenario *scenario, const SimSummary *summary, SimStepResponse *response)
+{
+    const SimTrajectoryPoint *points = summary->trajectory;
+    double finalFrom_s = scenario->duration * (1.0 - SIM_FINAL_SHARE);
+    double sum = 0;
+    u32 count = 0;
+
+    memset(response, 0, sizeof(*response));
+
+    for (u32 i = 0; i < summary->trajectoryCount; i++) {
+        if (points[i].time_s >= finalFrom_s) {
+            sum += points[i].socTemp;
+            count++;
+        }
+    }
+    if (count == 0)
+        return;
+    response->finalTemp = sum / count;
+
+    double lastOutside_s = scenario->settleFrom_s;
+    for (u32 i = 0; i < summary->trajectoryCount; i++) {
+        if (points[i].time_s < scenario->settleFrom_s)
+            continue;
+        if (points[i].socTemp > response->peakTemp) {
+            response->peakTemp = points[i].socTemp;
+            response->fanAtPeak = points[i].fanLevel;
+        }
+        response->overshoot = fmaxf(response->overshoot, points[i].socTemp - response->finalTemp);
+        if (fabsf(points[i].socTemp - response->finalTemp) > SIM_SETTLE_BAND)
+            lastOutside_s = points[i].time_s;
+    }
+    response->settling_s = lastOutside_s - scenario->settleFrom_s;
+}
+
+// Matches "name" or "name:params", pointing params past the colon
+static bool SpecName(const char *token, const char *name, const char **params)
+{
+    size_t length = strlen(name);
+
+    if (strncmp(token, name, length) != 0 || (token[length] != '\0' && token[length] != ':'))
+        return false;
+
+    *params = token[length] ? &token[length + 1] : NULL;
+    return true;
+}
+
+// "median:5,ema:0.3,kalman:0.05:0.5", stages in order, unset parameters
+// keep their defaults
+static bool ParseFilters(char *spec, SensorFilterStage *filters)
+{
+    char *save = NULL;
+    const char *params;
+    int stage = 0;
+
+    for (char *token = strtok_r(spec, ",", &save); token; token = strtok_r(NULL, ",", &save)) {
+        if (stage == SENSOR_FILTER_MAX_STAGES)
+            return false;
+
+        SensorFilterStage *filter = &filters[stage++];
+        if (SpecName(token, "median", &params)) {
+            filter->type = SensorFilter_Median;
+            if (params && sscanf(params, "%u", &filter->medianWindow) != 1)
+                return false;
+        } else if (SpecName(token, "ema", &params)) {
+            filter->type = SensorFilter_Ema;
+            if (params && sscanf(params, "%f", &filter->emaAlpha) != 1)
+                return false;
+        } else if (SpecName(token, "kalman", &params)) {
+            filter->type = SensorFilter_Kalman;
+            if (params && sscanf(params, "%f:%f", &filter->kalmanProcessNoise,
+                                 &filter->kalmanMeasurementNoise) < 1)
+                return false;
+        } else {
+            return false;
+        }
+    }
+
+    return stage > 0;
+}
+
+// "max", "blend" or "blend:weight", the weight defaulting to the controller's
+static bool ParseFusion(const char *spec, FanControllerOptions *options)
+{
+    const char *params;
+
+    if (strcmp(spec, "max") == 0) {
+        options->fusion = SensorFusion_Max;
+    } else if (SpecName(spec, "blend", &params)) {
+        options->fusion = SensorFusion_Blend;
+        if (params && (sscanf(params, "%f", &options->pcbWeight) != 1 ||
+                       options->pcbWeight < 0 || options->pcbWeight > 1))
+            return false;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+static void PrintMetric(const char *name, double baseline, double configured)
+{
+    double change = configured - baseline;
+
+    if (baseline != 0) {
+        printf("%s,%.2f,%.2f,%+.2f,%+.1f%%\n", name, baseline, configured, change, 100.0 * change / fabs(baseline));
+    } else {
+        printf("%s,%.2f,%.2f,%+.2f,\n", name, baseline, configured, change);
+    }
+}
+
+static void PrintComparison(const SimScenario *scenario, const SimRun *baseline, const SimRun *configured)
+{
+    SimStepResponse baseStep, configStep;
+    MeasureStepResponse(scenario, &baseline->summary, &baseStep);
+    MeasureStepResponse(scenario, &configured->summary, &configStep);
+
+    printf("metric,baseline,configured,change,change_pct\n");
+    PrintMetric("peak_soc_c", baseStep.peakTemp, configStep.peakTemp);
+    PrintMetric("fan_at_peak_pct", 100.0 * baseStep.fanAtPeak, 100.0 * configStep.fanAtPeak);
+    PrintMetric("peak_pcb_c", baseline->summary.peakPcbTemp, configured->summary.peakPcbTemp);
+    PrintMetric("final_soc_c", baseStep.finalTemp, configStep.finalTemp);
+    PrintMetric("overshoot_c", baseStep.overshoot, configStep.overshoot);
+    PrintMetric("settling_s", baseStep.settling_s, configStep.settling_s);
+    PrintMetric("mean_fan_pct", 100.0 * baseline->summary.fanLevelSeconds / scenario->duration,
+                100.0 * configured->summary.fanLevelSeconds / scenario->duration);
+    PrintMetric("fan_writes", baseline->stats.fanWrites, configured->stats.fanWrites);
+    PrintMetric("fan_writes_skipped", baseline->stats.fanWritesSkipped, configured->stats.fanWritesSkipped);
+    PrintMetric("max_fan_step_pct", 100.0 * baseline->summary.maxFanStep, 100.0 * configured->summary.maxFanStep);
+    PrintMetric("wakeups", baseline->stats.loopIterations, configured->stats.loopIterations);
+    PrintMetric("i2c_transactions", baseline->stats.i2cTransactions, configured->stats.i2cTransactions);
+    PrintMetric("pcb_reads", baseline->pcbReads, configured->pcbReads);
+    PrintMetric("status_polls", baseline->stats.loopIterations - baseline->summary.samples,
+                configured->stats.loopIterations - configured->summary.samples);
+    PrintMetric("limits_armed_samples", baseline->summary.armedSamples, configured->summary.armedSamples);
+    PrintMetric("alert_wakeups", baseline->summary.alertWakeups, configured->summary.alertWakeups);
+    PrintMetric("short_wakeups", baseline->summary.shortSleeps, configured->summary.shortSleeps);
+    PrintMetric("stable_sleep_pct", 100.0 * baseline->stats.sleepTimeNs[FanSleepTier_30s] / 1e9 / scenario->duration,
+                100.0 * configured->stats.sleepTimeNs[FanSleepTier_30s] / 1e9 / scenario->duration);
+    PrintMetric("armed_sleep_pct", 100.0 * baseline->stats.sleepTimeNs[FanSleepTier_120s] / 1e9 / scenario->duration,
+                100.0 * configured->stats.sleepTimeNs[FanSleepTier_120s] / 1e9 / scenario->duration);
+}
+
+enum
+{
+    SimOption_Compare = 0x100,
+    SimOption_Setpoint,
+    SimOption_PidGains,
+    SimOption_FeedForward,
+    SimOption_Hysteresis,
+    SimOption_Noise,
+    SimOption_Slew,
+    SimOption_Filter,
+    SimOption_Fusion,
+    SimOption_PcbCurve,
+    SimOption_PcbInterval,
+    SimOption_ThresholdWakeups,
+};
+
+static const struct option longOptions[] =
+{
+    { "compare",    no_argument,       NULL, SimOption_Compare },
+    { "pid",        no_argument,       NULL, 'p' },
+    { "setpoint",   required_argument, NULL, SimOption_Setpoint },
+    { "pid-gains",  required_argument, NULL, SimOption_PidGains },
+    { "feed-forward", required_argument, NULL, SimOption_FeedForward },
+    { "hysteresis", required_argument, NULL, SimOption_Hysteresis },
+    { "noise",      required_argument, NULL, SimOption_Noise },
+    { "slew",       required_argument, NULL, SimOption_Slew },
+    { "filter",     required_argument, NULL, SimOption_Filter },
+    { "fusion",     required_argument, NULL, SimOption_Fusion },
+    { "pcb-curve",  required_argument, NULL, SimOption_PcbCurve },
+    { "pcb-interval", required_argument, NULL, SimOption_PcbInterval },
+    { "threshold-wakeups", no_argument, NULL, SimOption_ThresholdWakeups },
+    { "help",       no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+static void Usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-d seconds] [-a ambient_c] [-P profile] [-T trace] [-R trace] [-c config.dat] [-s stall_s] [-L dir] [-p] [-q]\n"
+            "          [--compare] [--setpoint c] [--pid-gains kp,ki,kd] [--feed-forward s[,smoothing]]\n"
+            "          [--hysteresis c] [--noise sigma[,seed]] [--slew up[,down]]\n"
+            "          [--filter stage[,stage...]] [--fusion max|blend[:weight]] [--pcb-curve config.dat]\n"
+            "          [--pcb-interval seconds] [--threshold-wakeups]\n"
+            "  -d  simulated duration (default 3600, or the trace's length)\n"
+            "  -a  ambient temperature (default 25)\n"
+            "  -P  heat profile, \"seconds watts\" per line (default: built-in play session)\n"
+            "  -T  replay a sensor trace instead of running the thermal model\n"
+            "  -R  record the controller's sensor reads to a trace\n"
+            "  -c  fan curve in config.dat format (default: built-in curve)\n"
+            "  -s  fan stops moving air after this many seconds\n"
+            "  -L  keep the controller's log files under dir/config (default: discarded)\n"
+            "  -p, --pid   PID mode instead of the curve\n"
+            "  -q  summary only, no per-sample CSV\n"
+            "  --compare   run the default options first, then print metrics for both as CSV;\n"
+            "              the step response is measured from the last rise in power\n"
+            "  --setpoint  PID setpoint in C (default 55)\n"
+            "  --pid-gains PID gains (default 0.05,0.001,0)\n"
+            "  --feed-forward  lead the curve by the SoC slope over this many seconds; a replayed\n"
+            "              trace fixes the temperatures, so compare fan_at_peak_pct there\n"
+            "  --hysteresis  falling thresholds this many C below the rising ones\n"
+            "  --noise     Gaussian sensor noise in C, the same for both runs of --compare\n"
+            "  --slew      max fan level change per second up and down (down defaults to up);\n"
+            "              the per-sample CSV shows the ramp, short_wakeups its 1 s steps\n"
+            "  --filter    SoC reading filters in order, up to 3 of median[:n], ema[:alpha] and\n"
+            "              kalman[:q[:r]], e.g. median:5,kalman:0.05:0.5\n"
+            "  --fusion    combine the SoC curve with the PCB curve by the louder of the two, or\n"
+            "              blended with this PCB weight (default 0.5); needs --pcb-curve\n"
+            "  --pcb-curve PCB fan curve in config.dat format, used by both runs of --compare\n"
+            "  --pcb-interval  seconds between PCB reads (default 30), counted by pcb_reads\n"
+            "  --threshold-wakeups  arm the SoC limits while stable and poll only the status,\n"
+            "              every 120 s, until one crosses; status_polls counts those reads, alert_wakeups\n"
+            "              the full samples that followed an armed one\n",
+            name);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *profilePath = NULL;
+    const char *recordPath = NULL;
+    const char *logDir = NULL;
+    char recordPathBuffer[PATH_MAX];
+    char replayPathBuffer[PATH_MAX];
+    char curvePathBuffer[PATH_MAX];
+    char pcbCurvePathBuffer[PATH_MAX];
+    char scratch[] = "/tmp/fancontrol-sim-XXXXXX";
+    bool printSamples = true;
+    bool compare = false;
+
+    SimScenario scenario = { .stallAt = -1.0f };
+    ThermalModelDefaultParameters(&scenario.params);
+
+    FanControllerOptions options;
+    GetDefaultFanControllerOptions(&options);
+    options.binaryLog = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "d:a:P:T:R:c:s:L:pqh", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'd': scenario.duration = atof(optarg); break;
+            case 'a': scenario.params.ambient_c = atof(optarg); break;
+            case 'P': profilePath = optarg; break;
+            case 'T': scenario.replayPath = optarg; break;
+            case 'R': recordPath = optarg; break;
+            case 'c': scenario.curvePath = optarg; break;
+            case 's': scenario.stallAt = atof(optarg); break;
+            case 'L': logDir = optarg; break;
+            case 'p': options.mode = FanControlMode_Pid; break;
+            case 'q': printSamples = false; break;
+            case SimOption_Compare: compare = true; break;
+            case SimOption_Setpoint: options.pid.setpoint_c = atof(optarg); break;
+            case SimOption_PidGains:
+                if (sscanf(optarg, "%f,%f,%f", &options.pid.kp, &options.pid.ki, &options.pid.kd) != 3) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case SimOption_FeedForward:
+                if (sscanf(optarg, "%f,%f", &options.feedForwardLookahead_s, &options.feedForwardSmoothing) < 1) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case SimOption_Slew: {
+                int rates = sscanf(optarg, "%f,%f", &options.slewRateUp, &options.slewRateDown);
+                if (rates < 1) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                if (rates == 1)
+                    options.slewRateDown = options.slewRateUp;
+                break;
+            }
+            case SimOption_Filter:
+                if (!ParseFilters(optarg, options.filters)) {
+                    fprintf(stderr, "Invalid filter chain: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case SimOption_Fusion:
+                if (!ParseFusion(optarg, &options)) {
+                    fprintf(stderr, "Invalid sensor fusion: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case SimOption_PcbCurve: scenario.pcbCurvePath = optarg; break;
+            case SimOption_ThresholdWakeups: options.thresholdWakeups = true; break;
+            case SimOption_PcbInterval: options.pcbSampleInterval = (u64)(atof(optarg) * 1e9); break;
+            case SimOption_Hysteresis: options.hysteresis_c = atof(optarg); break;
+            case SimOption_Noise:
+                if (sscanf(optarg, "%f,%u", &scenario.noise, &scenario.noiseSeed) < 1) {
+                    Usage(argv[0]);
+                    return 1;
+                }
+                break;
+            default:
+                Usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (scenario.duration < 0) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    if (scenario.duration == 0 && scenario.replayPath) {
+        TraceReplay replay;
+        if (!TraceReplayLoad(&replay, scenario.replayPath)) {
+            fprintf(stderr, "Invalid sensor trace: %s\n", scenario.replayPath);
+            return 1;
+        }
+        scenario.duration = replay.durationNs / 1e9;
+        TraceReplayFree(&replay);
+    }
+    if (scenario.duration == 0)
+        scenario.duration = 3600.0;
+
+    scenario.profile = defaultProfile;
+    scenario.profileCount = sizeof(defaultProfile) / sizeof(defaultProfile[0]);
+    HeatProfilePoint *loadedProfile = NULL;
+    if (profilePath) {
+        if (!LoadHeatProfile(profilePath, &loadedProfile, &scenario.profileCount)) {
+            fprintf(stderr, "Invalid heat profile: %s\n", profilePath);
+            return 1;
+        }
+        scenario.profile = loadedProfile;
+    }
+
+    // From the last rise in power. A replayed trace has no steps to measure
+    // from, its whole length counts.
+    for (u32 i = 1; !scenario.replayPath && i < scenario.profileCount; i++) {
+        if (scenario.profile[i].power_w > scenario.profile[i - 1].power_w)
+            scenario.settleFrom_s = scenario.profile[i].time_s;
+    }
+
+    if (printSamples && !compare)
+        printf("time_s,soc_c,pcb_c,fan_level,flags,sleep_s\n");
+
+    recordPath = AbsolutePath(recordPath, recordPathBuffer, sizeof(recordPathBuffer));
+    scenario.replayPath = AbsolutePath(scenario.replayPath, replayPathBuffer, sizeof(replayPathBuffer));
+    scenario.curvePath = AbsolutePath(scenario.curvePath, curvePathBuffer, sizeof(curvePathBuffer));
+    scenario.pcbCurvePath = AbsolutePath(scenario.pcbCurvePath, pcbCurvePathBuffer, sizeof(pcbCurvePathBuffer));
+    if (!EnterLogDir(logDir, scratch)) {
+        fprintf(stderr, "Can't use log directory %s\n", logDir ? logDir : scratch);
+        return 1;
+    }
+
+    int status = 0;
+    SimRun baseline = {0};
+    SimRun configured = { .summary.printSamples = printSamples && !compare };
+
+    if (compare) {
+        FanControllerOptions defaults;
+        GetDefaultFanControllerOptions(&defaults);
+        defaults.binaryLog = false;
+
+        if (!RunSimulation(&scenario, &defaults, NULL, &baseline)) {
+            status = 1;
+        } else {
+            fprintf(stderr, "baseline: ");
+            PrintRunSummary(&scenario, &baseline);
+        }
+    }
+
+    if (status == 0 && !RunSimulation(&scenario, &options, recordPath, &configured))
+        status = 1;
+
+    if (status == 0) {
+        if (compare)
+            fprintf(stderr, "configured: ");
+        PrintRunSummary(&scenario, &configured);
+        if (compare)
+            PrintComparison(&scenario, &baseline, &configured);
+    }
+
+    free(baseline.summary.trajectory);
+    free(configured.summary.trajectory);
+    free(loadedProfile);
+    if (!logDir)
+        LeaveScratchDir(scratch);
+    return status;
+}
@@ -0,0 +1,315 @@
+#include "check.h"
+#include "fake_i2c.h"
+#include "i2c.h"
+#include "tmp451.h"
+
+//Session cache, batched command lists and the TMP451 driver in include/ against
+//the fake I2C service. The driver reaches the bus through the same mapping as
+//source/backend_nx.c, defined below instead of the controller's counting one.
+
+#define TEST_ERROR MAKERESULT(Module_Libnx, LibnxError_IoError)
+
+static void ResetCache()
+{
+    I2cCloseSessionCache();
+    memset(&i2cSessionCacheStats, 0, sizeof(i2cSessionCacheStats));
+    FakeI2cReset();
+}
+
+static void TestSessionOpenedOnce()
+{
+    FakeI2cStats fake;
+    I2cSessionCacheStats stats;
+    u8 val = 0;
+
+    ResetCache();
+    FakeI2cSetRegister(I2cDevice_Tmp451, 0x01, 42);
+
+    for (int i = 0; i < 100; i++) {
+        CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+        CHECK_EQ(val, 42);
+    }
+
+    FakeI2cGetStats(&fake);
+    I2cGetSessionCacheStats(&stats);
+    CHECK_EQ(fake.opens, 1);
+    CHECK_EQ(fake.closes, 0);
+    CHECK_EQ(fake.commandLists, 100);
+    CHECK_EQ(stats.opens, 1);
+    CHECK_EQ(stats.reopens, 0);
+    CHECK_EQ(stats.savedOpens, 99);
+}
+
+static void TestReopenAfterError()
+{
+    FakeI2cStats fake;
+    I2cSessionCacheStats stats;
+    u8 val = 0;
+
+    ResetCache();
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+
+    FakeI2cFailNextCommandList(TEST_ERROR);
+    CHECK_EQ(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val), TEST_ERROR);
+
+    // The failed session is closed right away rather than reused
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.closes, 1);
+    CHECK_EQ(fake.openSessions, 0);
+
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+
+    FakeI2cGetStats(&fake);
+    I2cGetSessionCacheStats(&stats);
+    CHECK_EQ(fake.opens, 2);
+    CHECK_EQ(fake.openSessions, 1);
+    CHECK_EQ(stats.opens, 2);
+    CHECK_EQ(stats.reopens, 1);
+    CHECK_EQ(stats.savedOpens, 2);
+}
+
+// Another device must neither take over the failed device's reopen count
+// nor be counted as a reopen itself
+static void TestReopenCountedPerDevice()
+{
+    I2cSessionCacheStats stats;
+    u8 val = 0;
+
+    ResetCache();
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+    FakeI2cFailNextCommandList(TEST_ERROR);
+    CHECK(R_FAILED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x00, I2cDevice_Max17050, &val)));
+    I2cGetSessionCacheStats(&stats);
+    CHECK_EQ(stats.reopens, 0);
+
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+    I2cGetSessionCacheStats(&stats);
+    CHECK_EQ(stats.opens, 3);
+    CHECK_EQ(stats.reopens, 1);
+}
+
+static void TestFailedOpen()
+{
+    FakeI2cStats fake;
+    I2cSessionCacheStats stats;
+    u8 val = 0;
+
+    ResetCache();
+    FakeI2cFailNextOpen(TEST_ERROR);
+    CHECK_EQ(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val), TEST_ERROR);
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x01, I2cDevice_Tmp451, &val)));
+
+    FakeI2cGetStats(&fake);
+    I2cGetSessionCacheStats(&stats);
+    CHECK_EQ(fake.opens, 2);
+    CHECK_EQ(fake.openSessions, 1);
+    CHECK_EQ(stats.opens, 1);
+    CHECK_EQ(stats.reopens, 0);
+}
+
+static void TestCacheFull()
+{
+    static const I2cDevice devices[] = {
+        I2cDevice_Tmp451, I2cDevice_Max17050, I2cDevice_Bq24193, I2cDevice_Max77620Pmic, I2cDevice_Max77621Cpu,
+    };
+    FakeI2cStats fake;
+    u8 val = 0;
+
+    ResetCache();
+    for (size_t i = 0; i < sizeof(devices) / sizeof(devices[0]); i++) {
+        CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x00, devices[i], &val)));
+    }
+
+    // One more device than slots recycles one session instead of leaking it
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.opens, 5);
+    CHECK_EQ(fake.closes, 1);
+    CHECK_EQ(fake.openSessions, I2C_SESSION_CACHE_SIZE);
+    CHECK_EQ(fake.invalidCalls, 0);
+}
+
+static void TestCloseCache()
+{
+    FakeI2cStats fake;
+    u8 val = 0;
+
+    ResetCache();
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x00, I2cDevice_Tmp451, &val)));
+    CHECK(R_SUCCEEDED(I2cReadRegHandler8(0x00, I2cDevice_Max17050, &val)));
+    I2cCloseSessionCache();
+    I2cCloseSessionCache();
+
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.openSessions, 0);
+    CHECK_EQ(fake.closes, 2);
+    CHECK_EQ(fake.invalidCalls, 0);
+}
+
+static u64 TestGetTick()
+{
+    return 0;
+}
+
+static const FanControllerBackend testBackend = {
+    .getTick = TestGetTick,
+};
+
+const FanControllerBackend *FanControllerGetBackend()
+{
+    return &testBackend;
+}
+
+Result FanBackendSensorReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+    return I2cReadRegsHandler8(regs, count, I2cDevice_Tmp451, out);
+}
+
+Result FanBackendSensorWriteRegs(const u8 *regs, const u8 *vals, size_t count)
+{
+    return I2cWriteRegsHandler8(regs, vals, count, I2cDevice_Tmp451);
+}
+
+// Scattered registers come back in request order from one command list
+static void TestBatchedRead()
+{
+    const u8 regs[] = { 0x15, 0x01, 0x10, 0x00, 0x02 };
+    u8 vals[5] = {0};
+    FakeI2cStats fake;
+
+    ResetCache();
+    for (size_t i = 0; i < sizeof(regs); i++) {
+        FakeI2cSetRegister(I2cDevice_Tmp451, regs[i], 0xA0 + i);
+    }
+
+    CHECK(R_SUCCEEDED(I2cReadRegsHandler8(regs, sizeof(regs), I2cDevice_Tmp451, vals)));
+    for (size_t i = 0; i < sizeof(regs); i++) {
+        CHECK_EQ(vals[i], 0xA0 + i);
+    }
+
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.commandLists, 1);
+    CHECK_EQ(fake.sends, sizeof(regs));
+    CHECK_EQ(fake.receives, sizeof(regs));
+    CHECK_EQ(fake.invalidCalls, 0);
+}
+
+static void TestBatchLimits()
+{
+    u8 regs[I2C_MAX_BATCH_REGS + 1] = {0};
+    u8 vals[I2C_MAX_BATCH_REGS + 1] = {0};
+    FakeI2cStats fake;
+
+    ResetCache();
+    CHECK(R_FAILED(I2cReadRegsHandler8(regs, 0, I2cDevice_Tmp451, vals)));
+    CHECK(R_FAILED(I2cReadRegsHandler8(regs, I2C_MAX_BATCH_REGS + 1, I2cDevice_Tmp451, vals)));
+    CHECK(R_FAILED(I2cWriteRegsHandler8(regs, vals, I2C_MAX_BATCH_REGS + 1, I2cDevice_Tmp451)));
+    CHECK(R_SUCCEEDED(I2cReadRegsHandler8(regs, I2C_MAX_BATCH_REGS, I2cDevice_Tmp451, vals)));
+
+    // Rejected batches never reach the service
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.commandLists, 1);
+    CHECK_EQ(fake.invalidCalls, 0);
+}
+
+static void TestBatchedWrite()
+{
+    const u8 regs[] = { 0x0D, 0x13, 0x0E, 0x14 };
+    const u8 vals[] = { 70, 0x80, 40, 0x40 };
+    FakeI2cStats fake;
+
+    ResetCache();
+    CHECK(R_SUCCEEDED(I2cWriteRegsHandler8(regs, vals, sizeof(regs), I2cDevice_Tmp451)));
+    for (size_t i = 0; i < sizeof(regs); i++) {
+        CHECK_EQ(FakeI2cGetRegister(I2cDevice_Tmp451, regs[i]), vals[i]);
+    }
+
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.commandLists, 1);
+    CHECK_EQ(fake.sends, sizeof(regs));
+    CHECK_EQ(fake.invalidCalls, 0);
+}
+
+static void TestRead16()
+{
+    u16 val = 0;
+
+    ResetCache();
+    FakeI2cSetRegister(I2cDevice_Max17050, 0x06, 0x34);
+    FakeI2cSetRegister(I2cDevice_Max17050, 0x07, 0x12);
+    CHECK(R_SUCCEEDED(I2cReadRegHandler16(0x06, I2cDevice_Max17050, &val)));
+    CHECK_EQ(val, 0x1234);
+}
+
+// One sample is one transaction, and the fraction nibble decodes in 1/16 oC
+static void TestTmp451Temperatures()
+{
+    Tmp451Snapshot snapshot;
+    float temperature = 0;
+    FakeI2cStats fake;
+
+    ResetCache();
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_SOC_TEMP_REG, 45);
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_SOC_TEMP_DEC_REG, 0x80);
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_PCB_TEMP_REG, 38);
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_PCB_TEMP_DEC_REG, 0x40);
+
+    CHECK(R_SUCCEEDED(Tmp451GetSocTemp(&temperature)));
+    CHECK(temperature == 45.5f);
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.commandLists, 1);
+
+    CHECK(R_SUCCEEDED(Tmp451GetSnapshot(&snapshot)));
+    CHECK(snapshot.socTemp == 45.5f);
+    CHECK(snapshot.pcbTemp == 38.25f);
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.commandLists, 2);
+
+    // Fractions are truncated to two decimals: 0x10 is 0.0625 oC
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_SOC_TEMP_DEC_REG, 0x10);
+    CHECK(R_SUCCEEDED(Tmp451GetSocTemp(&temperature)));
+    CHECK(temperature == 45.06f);
+}
+
+static void TestTmp451Limits()
+{
+    u8 raw[4] = {0};
+    FakeI2cStats fake;
+
+    ResetCache();
+    CHECK(R_SUCCEEDED(Tmp451SetSocLimits(41.25f, 52.5f)));
+    CHECK_EQ(FakeI2cGetRegister(I2cDevice_Tmp451, TMP451_SOC_TMP_HI_REG), 52);
+    CHECK_EQ(FakeI2cGetRegister(I2cDevice_Tmp451, TMP451_SOC_TMP_HI_DEC_REG), 0x80);
+    CHECK_EQ(FakeI2cGetRegister(I2cDevice_Tmp451, TMP451_SOC_TMP_LO_REG), 41);
+    CHECK_EQ(FakeI2cGetRegister(I2cDevice_Tmp451, TMP451_SOC_TMP_LO_DEC_REG), 0x40);
+
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_SOC_TMP_HI_READ_REG, 52);
+    FakeI2cSetRegister(I2cDevice_Tmp451, TMP451_SOC_TMP_LO_READ_REG, 41);
+    CHECK(R_SUCCEEDED(Tmp451GetSocLimitsRaw(raw)));
+    CHECK_EQ(raw[0], 52);
+    CHECK_EQ(raw[1], 0x80);
+    CHECK_EQ(raw[2], 41);
+    CHECK_EQ(raw[3], 0x40);
+
+    FakeI2cGetStats(&fake);
+    CHECK_EQ(fake.commandLists, 2);
+}
+
+int main()
+{
+    RUN_TEST(TestSessionOpenedOnce);
+    RUN_TEST(TestReopenAfterError);
+    RUN_TEST(TestReopenCountedPerDevice);
+    RUN_TEST(TestFailedOpen);
+    RUN_TEST(TestCacheFull);
+    RUN_TEST(TestCloseCache);
+    RUN_TEST(TestBatchedRead);
+    RUN_TEST(TestBatchLimits);
+    RUN_TEST(TestBatchedWrite);
+    RUN_TEST(TestRead16);
+    RUN_TEST(TestTmp451Temperatures);
+    RUN_TEST(TestTmp451Limits);
+    return CheckExit();
+}
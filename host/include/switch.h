@@ -0,0 +1,119 @@
+#pragma once
+
+//Host stand-in for the parts of libnx the controller uses directly: integer
+//types, Result codes and the thread, event and mutex primitives. Hardware
+//access goes through the backend vtable (fanbackend.h) and is not mirrored
+//here. Implemented on pthreads in host/switch_host.c.
+//
+//The I2C service is declared only so include/i2c.h builds in the host tests;
+//host/fake_i2c.c implements it as a scripted bus that counts IPC calls.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef int8_t   s8;
+typedef int16_t  s16;
+typedef int32_t  s32;
+typedef int64_t  s64;
+
+typedef u32 Result;
+
+#define R_SUCCEEDED(res) ((res) == 0)
+#define R_FAILED(res)    ((res) != 0)
+#define R_MODULE(res)    ((res) & 0x1FF)
+#define R_DESCRIPTION(res) (((res) >> 9) & 0x1FFF)
+#define MAKERESULT(module, description) ((((module) & 0x1FF)) | ((description) & 0x1FFF) << 9)
+#define KERNELRESULT(description) MAKERESULT(Module_Kernel, KernelError_##description)
+
+enum
+{
+    Module_Kernel = 1,
+    Module_Libnx  = 345,
+};
+
+enum
+{
+    KernelError_TimedOut = 117,
+};
+
+enum
+{
+    LibnxError_OutOfMemory       = 2,
+    LibnxError_ShouldNotHappen   = 3,
+    LibnxError_BadInput          = 4,
+    LibnxError_IoError           = 30,
+};
+
+typedef void (*ThreadFunc)(void *);
+
+typedef struct
+{
+    pthread_t   thread;
+    ThreadFunc  entry;
+    void       *arg;
+    bool        started;
+} Thread;
+
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            signaled;
+    bool            autoclear;
+} Event;
+
+// Zeroed statics are valid unlocked mutexes, as on libnx (glibc's
+// PTHREAD_MUTEX_INITIALIZER is all zeroes)
+typedef pthread_mutex_t Mutex;
+
+// Priority, core and stack arguments are accepted and ignored
+Result threadCreate(Thread *t, ThreadFunc entry, void *arg, void *stack_mem, size_t stack_sz, int prio, int cpuid);
+Result threadStart(Thread *t);
+Result threadWaitForExit(Thread *t);
+Result threadClose(Thread *t);
+
+Result eventCreate(Event *t, bool autoclear);
+Result eventWait(Event *t, u64 timeout);
+Result eventFire(Event *t);
+Result eventClear(Event *t);
+void eventClose(Event *t);
+
+void mutexInit(Mutex *m);
+void mutexLock(Mutex *m);
+void mutexUnlock(Mutex *m);
+
+void svcSleepThread(s64 nano);
+
+void diagAbortWithResult(Result res) __attribute__((noreturn));
+
+typedef enum
+{
+    I2cDevice_Max17050 = 5,
+    I2cDevice_Tmp451   = 14,
+    I2cDevice_Bq24193  = 16,
+    I2cDevice_Max77620Pmic = 21,
+    I2cDevice_Max77621Cpu  = 23,
+} I2cDevice;
+
+typedef enum
+{
+    I2cTransactionOption_Start = 1 << 0,
+    I2cTransactionOption_Stop  = 1 << 1,
+    I2cTransactionOption_All   = I2cTransactionOption_Start | I2cTransactionOption_Stop,
+} I2cTransactionOption;
+
+typedef struct
+{
+    I2cDevice   dev;
+    u32         id;     // Distinguishes sessions for the fake's bookkeeping
+} I2cSession;
+
+Result i2cOpenSession(I2cSession *out, I2cDevice dev);
+Result i2csessionExecuteCommandList(I2cSession *s, void *dst, size_t dst_size, const void *cmdlist, size_t cmdlist_size);
+void i2csessionClose(I2cSession *s);
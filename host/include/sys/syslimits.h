@@ -0,0 +1,4 @@
+#pragma once
+
+//newlib keeps PATH_MAX here, glibc in limits.h
+#include <limits.h>
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "fanbackend.h"
+
+//Simulated platform for host builds: a TMP451 register file, a fan that
+//remembers its level, a virtual clock that only moves while the controller
+//sleeps, and a settable focus state. Installed as fanControllerDefaultBackend.
+
+#define SIM_TICK_FREQUENCY 19200000ULL  // Same as the console's system counter
+
+//Register file behind the simulated TMP451, mapped from the datasheet rather
+//than tmp451.h so the driver is checked against an independent copy. Reads
+//and writes use split pointers like the real part (rate read 0x04, write 0x0A).
+#define SIM_REG_PCB_TEMP        0x00
+#define SIM_REG_SOC_TEMP        0x01
+#define SIM_REG_STATUS          0x02
+#define SIM_REG_CONFIG_READ     0x03
+#define SIM_REG_RATE_READ       0x04
+#define SIM_REG_SOC_HIGH_READ   0x07
+#define SIM_REG_SOC_LOW_READ    0x08
+#define SIM_REG_CONFIG_WRITE    0x09
+#define SIM_REG_RATE_WRITE      0x0A
+#define SIM_REG_SOC_HIGH_WRITE  0x0D
+#define SIM_REG_SOC_LOW_WRITE   0x0E
+#define SIM_REG_SOC_TEMP_DEC    0x10
+#define SIM_REG_SOC_HIGH_DEC    0x13
+#define SIM_REG_SOC_LOW_DEC     0x14
+#define SIM_REG_PCB_TEMP_DEC    0x15
+
+#define SIM_STATUS_SOC_HIGH     (1 << 4)
+#define SIM_STATUS_SOC_LOW      (1 << 3)
+
+typedef struct
+{
+    float   socTemp;        // Mirrored into the sensor registers after every step
+    float   pcbTemp;
+    float   fanLevel;       // Last level the controller set
+    bool    inFocus;
+    Result  sensorError;    // The next sensor read fails with this, then it clears
+    u64     timeNs;         // Simulated time since SimInit
+} SimState;
+
+// Moves the world forward by dtNs, called in steps of at most maxStepNs with
+// the simulator locked, so it must not call back into Sim* functions
+typedef void (*SimStepFunction)(SimState *state, u64 dtNs, void *user);
+
+// Called on the controller thread every time it goes to sleep, before time moves
+typedef void (*SimSleepCallback)(const SimState *state, u64 timeoutNs, void *user);
+
+// Starts a run that ends once durationNs of simulated time has passed
+void SimInit(const SimState *initial, u64 durationNs);
+void SimSetStepFunction(SimStepFunction step, u64 maxStepNs, void *user);
+void SimSetSleepCallback(SimSleepCallback callback, void *user);
+
+// Gaussian noise of sigma oC on both sensor readings, 0 to turn it off. Each
+// value is drawn from the seed and the simulated second, so runs over the
+// same input see the same noise however often they read.
+void SimSetSensorNoise(float sigma, u32 seed);
+void SimGetState(SimState *out);
+void SimSetInFocus(bool inFocus);
+
+// Register file as the controller last left it, and how often it wrote each
+// write address or read each read address since SimInit, for register-level tests
+u8 SimPeekRegister(u8 reg);
+u32 SimGetRegisterWrites(u8 reg);
+u32 SimGetRegisterReads(u8 reg);
+
+// Blocks until the run's duration has elapsed; the controller then idles until closed
+void SimWaitFinished();
@@ -0,0 +1,167 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <switch.h>
+
+//pthread implementations of the libnx primitives declared in host/include/switch.h
+
+static void *ThreadTrampoline(void *arg)
+{
+    Thread *t = (Thread *)arg;
+    t->entry(t->arg);
+    return NULL;
+}
+
+Result threadCreate(Thread *t, ThreadFunc entry, void *arg, void *stack_mem, size_t stack_sz, int prio, int cpuid)
+{
+    (void)stack_mem;
+    (void)stack_sz;
+    (void)prio;
+    (void)cpuid;
+
+    if (!t || !entry)
+        return MAKERESULT(Module_Libnx, LibnxError_BadInput);
+
+    t->entry = entry;
+    t->arg = arg;
+    t->started = false;
+    return 0;
+}
+
+Result threadStart(Thread *t)
+{
+    if (t->started || pthread_create(&t->thread, NULL, ThreadTrampoline, t) != 0)
+        return MAKERESULT(Module_Libnx, LibnxError_ShouldNotHappen);
+
+    t->started = true;
+    return 0;
+}
+
+Result threadWaitForExit(Thread *t)
+{
+    if (!t->started)
+        return MAKERESULT(Module_Libnx, LibnxError_BadInput);
+
+    if (pthread_join(t->thread, NULL) != 0)
+        return MAKERESULT(Module_Libnx, LibnxError_ShouldNotHappen);
+
+    t->started = false;
+    return 0;
+}
+
+Result threadClose(Thread *t)
+{
+    (void)t;
+    return 0;
+}
+
+Result eventCreate(Event *t, bool autoclear)
+{
+    if (pthread_mutex_init(&t->mutex, NULL) != 0)
+        return MAKERESULT(Module_Libnx, LibnxError_OutOfMemory);
+
+    if (pthread_cond_init(&t->cond, NULL) != 0) {
+        pthread_mutex_destroy(&t->mutex);
+        return MAKERESULT(Module_Libnx, LibnxError_OutOfMemory);
+    }
+
+    t->signaled = false;
+    t->autoclear = autoclear;
+    return 0;
+}
+
+// UINT64_MAX waits forever, as on the console
+Result eventWait(Event *t, u64 timeout)
+{
+    Result res = 0;
+    struct timespec deadline;
+
+    if (timeout != UINT64_MAX) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout / 1000000000ULL;
+        deadline.tv_nsec += timeout % 1000000000ULL;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&t->mutex);
+    while (!t->signaled) {
+        if (timeout == UINT64_MAX) {
+            pthread_cond_wait(&t->cond, &t->mutex);
+        } else if (pthread_cond_timedwait(&t->cond, &t->mutex, &deadline) == ETIMEDOUT) {
+            res = KERNELRESULT(TimedOut);
+            break;
+        }
+    }
+
+    if (R_SUCCEEDED(res) && t->autoclear)
+        t->signaled = false;
+    pthread_mutex_unlock(&t->mutex);
+
+    return res;
+}
+
+Result eventFire(Event *t)
+{
+    pthread_mutex_lock(&t->mutex);
+    t->signaled = true;
+    pthread_cond_broadcast(&t->cond);
+    pthread_mutex_unlock(&t->mutex);
+    return 0;
+}
+
+Result eventClear(Event *t)
+{
+    pthread_mutex_lock(&t->mutex);
+    t->signaled = false;
+    pthread_mutex_unlock(&t->mutex);
+    return 0;
+}
+
+void eventClose(Event *t)
+{
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->mutex);
+}
+
+void mutexInit(Mutex *m)
+{
+    pthread_mutex_init(m, NULL);
+}
+
+void mutexLock(Mutex *m)
+{
+    pthread_mutex_lock(m);
+}
+
+void mutexUnlock(Mutex *m)
+{
+    pthread_mutex_unlock(m);
+}
+
+// Zero yields, like the console's svcSleepThread(0)
+void svcSleepThread(s64 nano)
+{
+    if (nano <= 0) {
+        sched_yield();
+        return;
+    }
+
+    struct timespec duration = {
+        .tv_sec = nano / 1000000000LL,
+        .tv_nsec = nano % 1000000000LL,
+    };
+    while (nanosleep(&duration, &duration) == -1 && errno == EINTR);
+}
+
+void diagAbortWithResult(Result res)
+{
+    fprintf(stderr, "diagAbortWithResult: 0x%x (module %u, description %u)\n",
+            res, R_MODULE(res), R_DESCRIPTION(res));
+    abort();
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thermal_model.h"
+
+#define HEAT_PROFILE_MAX_POINTS 4096
+
+// Rough handheld figures: ~47 oC SoC at 10 W with the default curve, a SoC
+// time constant of about half a minute and a PCB that lags by several minutes
+void ThermalModelDefaultParameters(ThermalModelParameters *params)
+{
+    params->ambient_c = 25.0f;
+    params->socCapacitance = 15.0f;
+    params->pcbCapacitance = 60.0f;
+    params->socToPcbResistance = 2.0f;
+    params->pcbToAmbientResistance = 4.0f;
+    params->heatsinkConductance = 0.05f;
+    params->fanConductance = 0.45f;
+}
+
+void ThermalModelInit(ThermalModel *model, const ThermalModelParameters *params,
+                      const HeatProfilePoint *profile, u32 profileCount)
+{
+    model->params = *params;
+    model->profile = profile;
+    model->profileCount = profileCount;
+    model->profileIndex = 0;
+    model->stallAt_s = -1.0f;
+}
+
+static float ThermalModelPower(ThermalModel *model, float time_s)
+{
+    if (model->profileCount == 0)
+        return 0.0f;
+
+    while (model->profileIndex + 1 < model->profileCount &&
+           model->profile[model->profileIndex + 1].time_s <= time_s) {
+        model->profileIndex++;
+    }
+
+    return model->profile[model->profileIndex].power_w;
+}
+
+static float ThermalModelAirflow(const ThermalModel *model, const SimState *state, float time_s)
+{
+    // A stalled fan still reports its commanded level but moves no air
+    if (model->stallAt_s >= 0 && time_s >= model->stallAt_s)
+        return 0.0f;
+
+    return state->fanLevel;
+}
+
+void ThermalModelInitialState(const ThermalModel *model, SimState *state)
+{
+    const ThermalModelParameters *p = &model->params;
+    float power = model->profileCount ? model->profile[0].power_w : 0.0f;
+
+    // Steady state: the PCB path is R_sp and R_pa in series next to the heatsink
+    float socToPcb = 1.0f / p->socToPcbResistance;
+    float pcbToAmbient = 1.0f / p->pcbToAmbientResistance;
+    float pcbPath = socToPcb * pcbToAmbient / (socToPcb + pcbToAmbient);
+    float heatsink = p->heatsinkConductance + p->fanConductance * state->fanLevel;
+
+    float socRise = power / (pcbPath + heatsink);
+    state->socTemp = p->ambient_c + socRise;
+    state->pcbTemp = p->ambient_c + socRise * socToPcb / (socToPcb + pcbToAmbient);
+}
+
+void ThermalModelStep(SimState *state, u64 dtNs, void *user)
+{
+    ThermalModel *model = (ThermalModel *)user;
+    const ThermalModelParameters *p = &model->params;
+
+    float time_s = (float)((double)state->timeNs / 1e9);
+    float dt = (float)((double)dtNs / 1e9);
+
+    float power = ThermalModelPower(model, time_s);
+    float heatsink = p->heatsinkConductance + p->fanConductance * ThermalModelAirflow(model, state, time_s);
+
+    float socToPcbFlow = (state->socTemp - state->pcbTemp) / p->socToPcbResistance;
+    float socToAmbientFlow = (state->socTemp - p->ambient_c) * heatsink;
+    float pcbToAmbientFlow = (state->pcbTemp - p->ambient_c) / p->pcbToAmbientResistance;
+
+    state->socTemp += (power - socToPcbFlow - socToAmbientFlow) * dt / p->socCapacitance;
+    state->pcbTemp += (socToPcbFlow - pcbToAmbientFlow) * dt / p->pcbCapacitance;
+}
+
+bool LoadHeatProfile(const char *path, HeatProfilePoint **profile_out, u32 *count_out)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    HeatProfilePoint *profile = malloc(HEAT_PROFILE_MAX_POINTS * sizeof(HeatProfilePoint));
+    if (!profile) {
+        fclose(file);
+        return false;
+    }
+
+    u32 count = 0;
+    char line[256];
+    bool valid = true;
+
+    while (fgets(line, sizeof(line), file)) {
+        float time_s, power_w;
+        char *comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        int fields = sscanf(line, "%f %f", &time_s, &power_w);
+        if (fields == EOF)
+            continue; // Blank or comment-only line
+
+        // Times must increase and the table must fit
+        if (fields != 2 || count == HEAT_PROFILE_MAX_POINTS || power_w < 0 ||
+            (count > 0 && time_s <= profile[count - 1].time_s)) {
+            valid = false;
+            break;
+        }
+
+        profile[count].time_s = time_s;
+        profile[count].power_w = power_w;
+        count++;
+    }
+    fclose(file);
+
+    if (!valid || count == 0) {
+        free(profile);
+        return false;
+    }
+
+    *profile_out = profile;
+    *count_out = count;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "sim.h"
+
+//Lumped RC model of the console: the SoC (die, heatsink and heat pipe) and the
+//PCB are one thermal mass each. Heat enters at the SoC, flows to the PCB
+//through socToPcbResistance, and leaves to ambient through the fan-driven
+//heatsink and the PCB's own path.
+//
+//  C_soc dT_soc/dt = P(t) - (T_soc - T_pcb) / R_sp - (T_soc - T_amb) * (G_nat + G_fan * level)
+//  C_pcb dT_pcb/dt = (T_soc - T_pcb) / R_sp - (T_pcb - T_amb) / R_pa
+
+typedef struct
+{
+    float   ambient_c;
+    float   socCapacitance;             // J/K
+    float   pcbCapacitance;             // J/K
+    float   socToPcbResistance;         // K/W
+    float   pcbToAmbientResistance;     // K/W
+    float   heatsinkConductance;        // W/K with the fan stopped
+    float   fanConductance;             // W/K added at full fan level
+} ThermalModelParameters;
+
+//Heat input: each point holds its power until the next point's time
+typedef struct
+{
+    float   time_s;
+    float   power_w;
+} HeatProfilePoint;
+
+typedef struct
+{
+    ThermalModelParameters  params;
+    const HeatProfilePoint *profile;
+    u32                     profileCount;
+    u32                     profileIndex;   // Current point, only moves forward
+    float                   stallAt_s;      // Fan stops moving air from here on, negative never
+} ThermalModel;
+
+void ThermalModelDefaultParameters(ThermalModelParameters *params);
+void ThermalModelInit(ThermalModel *model, const ThermalModelParameters *params,
+                      const HeatProfilePoint *profile, u32 profileCount);
+
+// Equilibrium of both nodes at the profile's first power and fan level 0
+void ThermalModelInitialState(const ThermalModel *model, SimState *state);
+
+// SimStepFunction, user is the ThermalModel. Explicit Euler, keep steps well
+// below the SoC time constant (tens of seconds with the defaults).
+void ThermalModelStep(SimState *state, u64 dtNs, void *user);
+
+// "seconds watts" per line, '#' starts a comment. Caller frees *profile_out.
+bool LoadHeatProfile(const char *path, HeatProfilePoint **profile_out, u32 *count_out);
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fantrace.h"
+#include "trace_replay.h"
+
+typedef struct
+{
+    u8      type;
+    u64     delta;
+    size_t  payload;    // Offset of the payload in the trace data
+    size_t  end;        // Offset of the following record
+} TraceRecord;
+
+static bool TraceDecodeRecord(const TraceReplay *replay, size_t offset, TraceRecord *record)
+{
+    const u8 *data = replay->data;
+    size_t size = replay->size;
+
+    if (offset >= size)
+        return false;
+
+    record->type = data[offset++];
+    record->delta = 0;
+    for (int shift = 0; ; shift += 7) {
+        if (offset >= size || shift >= 7 * FANTRACE_MAX_VARINT_SIZE)
+            return false;
+        u8 byte = data[offset++];
+        record->delta |= (u64)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            break;
+    }
+    record->payload = offset;
+
+    size_t payloadSize;
+    switch (record->type) {
+        case FANTRACE_RECORD_SENSOR:
+            if (offset >= size || data[offset] == 0 || data[offset] > FANTRACE_MAX_REGS)
+                return false;
+            payloadSize = 1 + 2 * (size_t)data[offset];
+            break;
+        case FANTRACE_RECORD_ERROR:
+            payloadSize = 4;
+            break;
+        case FANTRACE_RECORD_FOCUS:
+            payloadSize = 1;
+            break;
+        default:
+            return false;
+    }
+
+    if (size - offset < payloadSize)
+        return false;
+
+    record->end = offset + payloadSize;
+    return true;
+}
+
+static u64 TraceTicksToNs(const TraceReplay *replay, u64 ticks)
+{
+    u64 frequency = replay->tickFrequency;
+    return (ticks / frequency) * 1000000000ULL + (ticks % frequency) * 1000000000ULL / frequency;
+}
+
+// Positions the replay on the record at offset, or marks the end
+static void TraceReplaySeek(TraceReplay *replay, size_t offset, u64 tick)
+{
+    TraceRecord record;
+
+    replay->offset = offset;
+    replay->nextValid = TraceDecodeRecord(replay, offset, &record);
+    if (replay->nextValid)
+        replay->nextTick = tick + record.delta;
+}
+
+static void TraceReplayApply(TraceReplay *replay, const TraceRecord *record)
+{
+    const u8 *payload = &replay->data[record->payload];
+
+    switch (record->type) {
+        case FANTRACE_RECORD_SENSOR:
+            for (u8 i = 0; i < payload[0]; i++) {
+                replay->registers[payload[1 + 2 * i]] = payload[2 + 2 * i];
+            }
+            replay->sensorSeen = true;
+            break;
+        case FANTRACE_RECORD_ERROR:
+            replay->pendingError = (Result)payload[0] | (Result)payload[1] << 8 |
+                                   (Result)payload[2] << 16 | (Result)payload[3] << 24;
+            break;
+        case FANTRACE_RECORD_FOCUS:
+            replay->inFocus = payload[0] != 0;
+            break;
+    }
+}
+
+static void TraceReplayApplyNext(TraceReplay *replay)
+{
+    TraceRecord record;
+    TraceDecodeRecord(replay, replay->offset, &record);
+    TraceReplayApply(replay, &record);
+    TraceReplaySeek(replay, record.end, replay->nextTick);
+}
+
+static void TraceReplayApplyUntil(TraceReplay *replay, u64 timeNs)
+{
+    while (replay->nextValid && TraceTicksToNs(replay, replay->nextTick) <= timeNs) {
+        TraceReplayApplyNext(replay);
+    }
+}
+
+static void TraceReplayUpdateState(TraceReplay *replay, SimState *state)
+{
+    state->socTemp = replay->registers[SIM_REG_SOC_TEMP] + (replay->registers[SIM_REG_SOC_TEMP_DEC] >> 4) / 16.0f;
+    state->pcbTemp = replay->registers[SIM_REG_PCB_TEMP] + (replay->registers[SIM_REG_PCB_TEMP_DEC] >> 4) / 16.0f;
+    state->inFocus = replay->inFocus;
+
+    if (R_FAILED(replay->pendingError)) {
+        state->sensorError = replay->pendingError;
+        replay->pendingError = 0;
+    }
+}
+
+bool TraceReplayLoad(TraceReplay *replay, const char *path)
+{
+    memset(replay, 0, sizeof(*replay));
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+
+    if (size < (long)sizeof(FanTraceHeader) || !(replay->data = malloc(size)) ||
+        fread(replay->data, 1, size, file) != (size_t)size) {
+        fclose(file);
+        TraceReplayFree(replay);
+        return false;
+    }
+    fclose(file);
+    replay->size = size;
+
+    FanTraceHeader header;
+    memcpy(&header, replay->data, sizeof(header));
+    if (header.magic != FANTRACE_MAGIC || header.version != FANTRACE_VERSION || header.tickFrequency == 0) {
+        TraceReplayFree(replay);
+        return false;
+    }
+    replay->tickFrequency = header.tickFrequency;
+
+    // A truncated tail (recorder stopped by a crash) ends the trace early
+    TraceRecord record;
+    size_t offset = sizeof(header);
+    u64 tick = 0;
+    u64 firstDelta = 0;
+    while (TraceDecodeRecord(replay, offset, &record)) {
+        if (offset == sizeof(header))
+            firstDelta = record.delta;
+        tick += record.delta;
+        offset = record.end;
+    }
+    replay->size = offset;
+
+    // Time 0 is the first record rather than the moment recording started
+    replay->durationNs = TraceTicksToNs(replay, tick - firstDelta);
+    replay->inFocus = true;
+    TraceReplaySeek(replay, sizeof(header), 0 - firstDelta);
+    return true;
+}
+
+void TraceReplayFree(TraceReplay *replay)
+{
+    free(replay->data);
+    replay->data = NULL;
+    replay->size = 0;
+    replay->nextValid = false;
+}
+
+void TraceReplayInitialState(TraceReplay *replay, SimState *state)
+{
+    TraceReplayApplyUntil(replay, 0);
+
+    // A focus check usually precedes the first read by a moment, hold the
+    // first temperatures back to time 0 so the first sample isn't all zeroes
+    while (!replay->sensorSeen && replay->nextValid) {
+        TraceReplayApplyNext(replay);
+    }
+
+    TraceReplayUpdateState(replay, state);
+}
+
+void TraceReplayStep(SimState *state, u64 dtNs, void *user)
+{
+    TraceReplay *replay = (TraceReplay *)user;
+
+    // Registers after the step hold what was recorded by its end
+    TraceReplayApplyUntil(replay, state->timeNs + dtNs);
+    TraceReplayUpdateState(replay, state);
+}
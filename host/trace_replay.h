@@ -0,0 +1,36 @@
+#pragma once
+
+#include "sim.h"
+
+//Replays a sensor trace (fantrace.h) through the simulated backend. The
+//recorded temperature registers, read errors and focus changes are applied
+//at their recorded times and held until the next record, so the controller
+//sees the same inputs at the same virtual times even if it changed how
+//often it samples. Status, limit and rate registers stay emulated by the
+//simulator, because they depend on what the controller under test writes.
+
+typedef struct
+{
+    u8     *data;
+    size_t  size;
+    size_t  offset;             // Next unread record
+    u64     tickFrequency;
+    u64     nextTick;           // Ticks from the first record to the next one
+    bool    nextValid;
+    u64     durationNs;         // From the first record to the last
+    u8      registers[256];     // Last recorded value of every register
+    bool    inFocus;
+    bool    sensorSeen;         // Registers hold at least one recorded read
+    Result  pendingError;
+} TraceReplay;
+
+// Loads the whole file and validates every record up front
+bool TraceReplayLoad(TraceReplay *replay, const char *path);
+void TraceReplayFree(TraceReplay *replay);
+
+// Applies the records at time 0, and the first sensor read if it came later,
+// to the simulator's starting state
+void TraceReplayInitialState(TraceReplay *replay, SimState *state);
+
+// SimStepFunction, user is the TraceReplay
+void TraceReplayStep(SimState *state, u64 dtNs, void *user);
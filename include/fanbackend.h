@@ -0,0 +1,48 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <switch.h>
+
+//Platform backend: everything the controller needs from the outside world.
+//The Switch build links source/backend_nx.c, host builds link a simulated
+//backend instead (see host/). Both define fanControllerDefaultBackend.
+typedef struct
+{
+    //Sensor: TMP451 register access, one bus transaction per call
+    Result  (*sensorReadRegs)(const u8 *regs, size_t count, u8 *out);
+    Result  (*sensorWriteRegs)(const u8 *regs, const u8 *vals, size_t count);
+    void    (*sensorClose)(void);
+    void    (*sensorGetSessionStats)(u32 *opens, u32 *reopens, u32 *savedOpens);  // Optional
+
+    //Fan
+    Result  (*fanOpen)(void);
+    Result  (*fanSetLevel)(float level);
+    Result  (*fanGetLevel)(float *level);
+    void    (*fanClose)(void);
+
+    //Clock and sleep
+    u64     (*getTick)(void);
+    u64     (*getTickFrequency)(void);
+    void    (*waitForWakeup)(Event *event, u64 timeoutNs);             // event is NULL when unavailable
+
+    //Power state
+    bool    (*isInFocus)(void);
+} FanControllerBackend;
+
+extern const FanControllerBackend fanControllerDefaultBackend;
+
+// Only while the controller thread is stopped. NULL restores the default.
+void FanControllerSetBackend(const FanControllerBackend *backend);
+const FanControllerBackend *FanControllerGetBackend();
+u64 FanBackendTicksToNs(u64 ticks);
+
+// Sensor access through the active backend, counted in FanControllerGetStats
+Result FanBackendSensorReadRegs(const u8 *regs, size_t count, u8 *out);
+Result FanBackendSensorWriteRegs(const u8 *regs, const u8 *vals, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
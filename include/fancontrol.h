@@ -14,11 +14,17 @@ extern "C" {
 
 #include <switch.h>
 
+#include "fanbackend.h"
+#include "fanlog.h"
+
 #define LOG_DIR "./config/NX-FanControl/"
-#define LOG_FILE "./config/NX-FanControl/log.txt"
+#define LOG_FILE "./config/NX-FanControl/log.bin"
+#define LOG_TEXT_FILE "./config/NX-FanControl/log.txt"
+#define TRACE_FILE "./config/NX-FanControl/trace.bin"
 #define CONFIG_DIR "./config/NX-FanControl/"
 #define CONFIG_FILE "./config/NX-FanControl/config.dat"
-#define TABLE_SIZE sizeof(TemperaturePoint) * 5
+#define FAN_CURVE_MIN_POINTS 2
+#define FAN_CURVE_MAX_POINTS 64
 
 
 typedef struct
@@ -27,15 +33,138 @@ typedef struct
     float   fanLevel_f;
 } TemperaturePoint;
 
-void WriteConfigFile(TemperaturePoint *table);
-void ReadConfigFile(TemperaturePoint **table_out);
+typedef enum
+{
+    FanControlMode_Table = 0,   // Interpolate the fan curve
+    FanControlMode_Pid   = 1,   // Hold pid.setpoint_c with a PID loop
+} FanControlMode;
+
+typedef struct
+{
+    float   setpoint_c;
+    float   kp;                 // Fan level per oC above the setpoint
+    float   ki;                 // Fan level per oC*s of accumulated error
+    float   kd;                 // Fan level per oC/s of temperature rise
+    float   outputMin;
+    float   outputMax;
+} PidParameters;
+
+//Sensor filter chain, applied in order to every SOC reading before control.
+//Out-of-range parameters are clamped at init. Emergencies and the slew bypass
+//still look at the raw reading whenever it is hotter than the filtered one.
+#define SENSOR_FILTER_MAX_STAGES 3
+#define SENSOR_FILTER_MAX_MEDIAN 7
+#define SENSOR_FILTER_MIN_EMA_ALPHA 0.05f       // Lower would all but freeze the reading
+#define SENSOR_FILTER_MIN_KALMAN_NOISE 0.001f   // Process noise, at 0 the gain decays to nothing
+
+typedef enum
+{
+    SensorFilter_None   = 0,    // Ends the chain
+    SensorFilter_Median = 1,    // Median of the last medianWindow readings, rejects spikes
+    SensorFilter_Ema    = 2,    // Exponential moving average
+    SensorFilter_Kalman = 3,    // Scalar Kalman filter on a constant-temperature model
+} SensorFilterType;
+
+typedef struct
+{
+    SensorFilterType    type;
+    u32                 medianWindow;           // Odd, 3..SENSOR_FILTER_MAX_MEDIAN
+    float               emaAlpha;               // Weight of the newest reading, SENSOR_FILTER_MIN_EMA_ALPHA..1
+    float               kalmanProcessNoise;     // oC^2 of drift per reading, at least SENSOR_FILTER_MIN_KALMAN_NOISE
+    float               kalmanMeasurementNoise; // oC^2 of sensor noise, 0 or more
+} SensorFilterStage;
 
-void InitFanController(TemperaturePoint *table);
+typedef enum
+{
+    SensorFusion_SocOnly = 0,   // PCB curve ignored
+    SensorFusion_Max     = 1,   // Louder of the SOC and PCB curve outputs
+    SensorFusion_Blend   = 2,   // Weighted by pcbWeight
+} SensorFusionMode;
+
+typedef struct
+{
+    bool            thresholdWakeups;   // Table mode: while stable, arm TMP451 SOC limits and poll only its latched
+                                        // status, every 2 minutes instead of 30 s, until a limit is crossed
+    bool            binaryLog;          // Append samples to LOG_FILE in batches
+    bool            sensorTrace;        // Record raw sensor reads and focus changes to TRACE_FILE for replay
+    FanControlMode  mode;
+    PidParameters   pid;                // Used in FanControlMode_Pid
+    float           feedForwardLookahead_s; // Table mode: evaluate the curve this far ahead along the rising slope, 0 disables
+    float           feedForwardSmoothing;   // EMA weight of the newest slope sample, 0..1
+    float           hysteresis_c;           // Table mode: falling threshold sits this far below the rising one, 0 disables
+    float           slewRateUp;             // Max fan level increase per second, 0 disables
+    float           slewRateDown;           // Max fan level decrease per second, 0 disables
+    SensorFilterStage filters[SENSOR_FILTER_MAX_STAGES];
+    SensorFusionMode fusion;                // Table mode: combine the SOC curve with FanControllerSetPcbCurve's
+    float           pcbWeight;              // SensorFusion_Blend: weight of the PCB curve, 0..1
+    u64             pcbSampleInterval;      // Min ns between PCB reads when fused, PCB moves slowly
+} FanControllerOptions;
+
+//Telemetry: one sample per full controller iteration, kept in a ring of
+//FAN_TELEMETRY_RING_SIZE entries that readers poll without locking
+#define FAN_TELEMETRY_RING_SIZE 64
+
+typedef struct
+{
+    u64     tick;           // Backend tick of the sensor read
+    float   socTemp;
+    float   pcbTemp;
+    float   fanLevel;
+    u32     flags;          // FAN_SAMPLE_FLAG_*
+    u64     sleepTime;      // Interval chosen after this sample, in ns
+} FanControllerSample;
+
+//Accounting: monotonic counters since the sysmodule started, updated by the
+//controller thread and readable from any thread without locking. Each counter
+//is read atomically, the set as a whole is not a consistent snapshot.
+typedef enum
+{
+    FanSleepTier_1s,        // Emergency and ramp steps
+    FanSleepTier_2s,        // Near-critical temperatures
+    FanSleepTier_5s,        // Rapid changes
+    FanSleepTier_10s,       // Active, and retries after a failed read
+    FanSleepTier_30s,       // Stable
+    FanSleepTier_120s,      // Status polls with SOC limits armed
+    FanSleepTier_300s,      // Sleep mode
+    FanSleepTier_Count
+} FanSleepTier;
+
+typedef struct
+{
+    u64     loopIterations;
+    u64     i2cTransactions;    // Sensor register reads and writes, batched ones count once
+    u64     i2cFailures;
+    u64     fanWrites;
+    u64     fanWritesSkipped;   // Full iterations that left the fan level as it was
+    u64     sleepTimeNs[FanSleepTier_Count];    // Time actually asleep, by requested interval
+} FanControllerStats;
+
+void WriteConfigFile(TemperaturePoint *table, u32 pointCount);
+void ReadConfigFile(TemperaturePoint **table_out, u32 *pointCount_out);
+TemperaturePoint *ReadConfigCurve(FILE *config, u32 *pointCount_out);
+bool ValidateFanCurve(const TemperaturePoint *table, u32 pointCount);
+
+void GetDefaultFanControllerOptions(FanControllerOptions *options);
+void InitFanController(TemperaturePoint *table, u32 pointCount);
+void InitFanControllerWithOptions(TemperaturePoint *table, u32 pointCount, const FanControllerOptions *options);
 void FanControllerThreadFunction(void*);
 void StartFanControllerThread();
 void CloseFanControllerThread();
 void WaitFanController();
-void WriteLog(char *buffer);
+void WakeFanController();
+bool FanControllerSetCurve(const TemperaturePoint *table, u32 pointCount);
+bool FanControllerSetPcbCurve(const TemperaturePoint *table, u32 pointCount);
+size_t FanControllerReadSamples(u64 *cursor, FanControllerSample *out, size_t maxSamples);
+void FanControllerGetLogStats(u32 *queued, u32 *dropped);
+void FanControllerGetStats(FanControllerStats *stats);
+void FanControllerGetI2cSessionStats(u32 *opens, u32 *reopens, u32 *savedOpens);
+bool FanTraceStart(const char *path);
+void FanTraceStop();
+
+//Trace buffers reach storage on the log writer thread
+void FanTraceFlush();
+void FanTraceWriteBuffers();
+void WakeLogWriter();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,38 @@
+#pragma once
+
+//Binary log written to LOG_FILE: a FanLogHeader followed by fixed-size
+//FanLogRecords, little-endian. Only depends on stdint so host tools can
+//include it to decode logs pulled off the console.
+
+#include <stdint.h>
+
+#define FANLOG_MAGIC   0x474C4346 // "FCLG"
+#define FANLOG_VERSION 1
+
+#define FANLOG_RECORD_SAMPLE 1
+
+//Sample flags, shared by FanControllerSample and FanLogRecord
+#define FAN_SAMPLE_FLAG_EMERGENCY    (1 << 0)
+#define FAN_SAMPLE_FLAG_SLEEP_MODE   (1 << 1)
+#define FAN_SAMPLE_FLAG_FAN_WRITTEN  (1 << 2)
+#define FAN_SAMPLE_FLAG_LIMITS_ARMED (1 << 3)
+#define FAN_SAMPLE_FLAG_FAN_STALLED  (1 << 4)
+
+typedef struct __attribute__((packed))
+{
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    recordSize;     // sizeof(FanLogRecord) of the writer
+    uint64_t    tickFrequency;  // System ticks per second
+    uint64_t    startTick;      // Tick at which the log was created
+} FanLogHeader;
+
+typedef struct __attribute__((packed))
+{
+    uint64_t    tick;           // System tick of the sensor read
+    int16_t     socTemp;        // Hundredths of a degree C
+    int16_t     pcbTemp;        // Hundredths of a degree C
+    uint16_t    fanLevel;       // Ten-thousandths of full speed
+    uint8_t     flags;          // FAN_SAMPLE_FLAG_*
+    uint8_t     type;           // FANLOG_RECORD_*
+} FanLogRecord;
@@ -0,0 +1,28 @@
+#pragma once
+
+//Sensor trace written to TRACE_FILE: a FanTraceHeader followed by
+//variable-length records. Each record is a type byte, the ticks since the
+//previous record (or startTick) as an unsigned LEB128 varint, then a payload
+//that depends on the type. Only depends on stdint, like fanlog.h.
+
+#include <stdint.h>
+
+#define FANTRACE_MAGIC   0x52544346 // "FCTR"
+#define FANTRACE_VERSION 1
+
+#define FANTRACE_RECORD_SENSOR 1    // u8 count, then count pairs of u8 register, u8 value
+#define FANTRACE_RECORD_ERROR  2    // u32 Result of a failed sensor read, little-endian
+#define FANTRACE_RECORD_FOCUS  3    // u8, 1 when in focus. Only written on change.
+
+#define FANTRACE_MAX_REGS        8
+#define FANTRACE_MAX_VARINT_SIZE 10
+#define FANTRACE_MAX_RECORD_SIZE (1 + FANTRACE_MAX_VARINT_SIZE + 1 + 2 * FANTRACE_MAX_REGS)
+
+typedef struct __attribute__((packed))
+{
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    reserved;
+    uint64_t    tickFrequency;  // System ticks per second
+    uint64_t    startTick;      // Tick at which recording started
+} FanTraceHeader;
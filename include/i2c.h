@@ -1,8 +1,130 @@
 #ifndef I2C_H
 #define I2C_H
 
+#include <string.h>
 #include <switch.h>
 
+//Session cache: one session per device, opened on first use and kept open
+//for the controller's lifetime instead of once per register read
+#define I2C_SESSION_CACHE_SIZE 4
+
+typedef struct
+{
+	I2cDevice	dev;
+	I2cSession	session;
+	bool		open;
+	bool		failed;		// closed after an error, next open is a reopen
+} I2cCachedSession;
+
+typedef struct
+{
+	u32	opens;			// i2cOpenSession calls actually made
+	u32	reopens;		// opens that followed an error on a cached session
+	u32	savedOpens;		// transactions served by an already open session
+} I2cSessionCacheStats;
+
+static I2cCachedSession i2cSessionCache[I2C_SESSION_CACHE_SIZE];
+static I2cSessionCacheStats i2cSessionCacheStats;
+
+static int I2cSlotPreference(const I2cCachedSession *entry, I2cDevice dev)
+{
+	if (entry->failed)
+		return entry->dev == dev ? 2 : 0;
+	return 1;
+}
+
+Result I2cGetCachedSession(I2cDevice dev, I2cSession **out)
+{
+	I2cCachedSession *freeSlot = NULL;
+
+	for (int i = 0; i < I2C_SESSION_CACHE_SIZE; i++)
+	{
+		I2cCachedSession *entry = &i2cSessionCache[i];
+		if (entry->open && entry->dev == dev)
+		{
+			i2cSessionCacheStats.savedOpens++;
+			*out = &entry->session;
+			return 0;
+		}
+		// Prefer the slot this device was dropped from after an error, then
+		// one no other device failed in, so that device's reopen is seen too
+		if (!entry->open && (!freeSlot || I2cSlotPreference(entry, dev) > I2cSlotPreference(freeSlot, dev)))
+			freeSlot = entry;
+	}
+
+	// Cache full, fall back to recycling the first slot
+	if (!freeSlot)
+	{
+		freeSlot = &i2cSessionCache[0];
+		i2csessionClose(&freeSlot->session);
+		freeSlot->open = false;
+	}
+
+	Result res = i2cOpenSession(&freeSlot->session, dev);
+	if (res)
+		return res;
+
+	i2cSessionCacheStats.opens++;
+	if (freeSlot->failed && freeSlot->dev == dev)
+		i2cSessionCacheStats.reopens++;
+	freeSlot->failed = false;
+
+	freeSlot->dev = dev;
+	freeSlot->open = true;
+	*out = &freeSlot->session;
+	return 0;
+}
+
+// Drops the cached session of a device so that the next transaction reopens it
+void I2cInvalidateCachedSession(I2cDevice dev)
+{
+	for (int i = 0; i < I2C_SESSION_CACHE_SIZE; i++)
+	{
+		I2cCachedSession *entry = &i2cSessionCache[i];
+		if (entry->open && entry->dev == dev)
+		{
+			i2csessionClose(&entry->session);
+			entry->open = false;
+			entry->failed = true;
+		}
+	}
+}
+
+void I2cCloseSessionCache()
+{
+	for (int i = 0; i < I2C_SESSION_CACHE_SIZE; i++)
+	{
+		I2cCachedSession *entry = &i2cSessionCache[i];
+		if (entry->open)
+		{
+			i2csessionClose(&entry->session);
+			entry->open = false;
+		}
+		entry->failed = false;
+	}
+}
+
+void I2cGetSessionCacheStats(I2cSessionCacheStats *out)
+{
+	*out = i2cSessionCacheStats;
+}
+
+// Runs a command list on the cached session of dev, invalidating it on failure
+Result I2cExecuteCommandList(I2cDevice dev, void *dst, size_t dstSize, const void *cmdList, size_t cmdListSize)
+{
+	I2cSession *session;
+
+	Result res = I2cGetCachedSession(dev, &session);
+	if (res)
+		return res;
+
+	res = i2csessionExecuteCommandList(session, dst, dstSize, cmdList, cmdListSize);
+	if (res)
+		I2cInvalidateCachedSession(dev);
+
+	return res;
+}
+
 Result I2cReadRegHandler16(u8 reg, I2cDevice dev, u16 *out)
 {
 	struct readReg {
@@ -13,12 +135,6 @@ Result I2cReadRegHandler16(u8 reg, I2cDevice dev, u16 *out)
         u8 receiveLength;
     };
 
-	I2cSession _session;
-
-	Result res = i2cOpenSession(&_session, dev);
-	if (res)
-		return res;
-
 	u16 val;
 
     struct readReg readRegister = {
@@ -29,15 +145,11 @@ Result I2cReadRegHandler16(u8 reg, I2cDevice dev, u16 *out)
         .receiveLength = sizeof(val),
     };
 
-	res = i2csessionExecuteCommandList(&_session, &val, sizeof(val), &readRegister, sizeof(readRegister));
+	Result res = I2cExecuteCommandList(dev, &val, sizeof(val), &readRegister, sizeof(readRegister));
 	if (res)
-	{
-		i2csessionClose(&_session);
 		return res;
-	}
 
 	*out = val;
-	i2csessionClose(&_session);
 	return 0;
 }
 
@@ -51,12 +163,6 @@ Result I2cReadRegHandler8(u8 reg, I2cDevice dev, u8 *out)
         u8 receiveLength;
     };
 
-	I2cSession _session;
-
-	Result res = i2cOpenSession(&_session, dev);
-	if (res)
-		return res;
-
 	u8 val;
 
     struct readReg readRegister = {
@@ -67,16 +173,81 @@ Result I2cReadRegHandler8(u8 reg, I2cDevice dev, u8 *out)
         .receiveLength = sizeof(val),
     };
 
-	res = i2csessionExecuteCommandList(&_session, &val, sizeof(val), &readRegister, sizeof(readRegister));
+	Result res = I2cExecuteCommandList(dev, &val, sizeof(val), &readRegister, sizeof(readRegister));
 	if (res)
-	{
-		i2csessionClose(&_session);
 		return res;
-	}
 
 	*out = val;
-	i2csessionClose(&_session);
 	return 0;
 }
 
-#endif
\ No newline at end of file
+//Batched reads: every register becomes one send/receive pair of the same
+//command list, so the whole batch costs a single bus transaction
+#define I2C_MAX_BATCH_REGS 8
+
+Result I2cReadRegsHandler8(const u8 *regs, size_t count, I2cDevice dev, u8 *out)
+{
+	struct readReg {
+        u8 send;
+        u8 sendLength;
+        u8 sendData;
+        u8 receive;
+        u8 receiveLength;
+    };
+
+	if (count == 0 || count > I2C_MAX_BATCH_REGS)
+		return MAKERESULT(Module_Libnx, LibnxError_BadInput);
+
+	struct readReg commandList[I2C_MAX_BATCH_REGS];
+	u8 vals[I2C_MAX_BATCH_REGS];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		commandList[i] = (struct readReg) {
+			.send = 0 | (I2cTransactionOption_Start << 6),
+			.sendLength = sizeof(regs[i]),
+			.sendData = regs[i],
+			.receive = 1 | (I2cTransactionOption_All << 6),
+			.receiveLength = sizeof(vals[i]),
+		};
+	}
+
+	Result res = I2cExecuteCommandList(dev, vals, count * sizeof(vals[0]), commandList, count * sizeof(commandList[0]));
+	if (res)
+		return res;
+
+	memcpy(out, vals, count * sizeof(vals[0]));
+	return 0;
+}
+
+Result I2cWriteRegsHandler8(const u8 *regs, const u8 *vals, size_t count, I2cDevice dev)
+{
+	struct writeReg {
+        u8 send;
+        u8 sendLength;
+        u8 sendData[2];
+    };
+
+	if (count == 0 || count > I2C_MAX_BATCH_REGS)
+		return MAKERESULT(Module_Libnx, LibnxError_BadInput);
+
+	struct writeReg commandList[I2C_MAX_BATCH_REGS];
+
+	for (size_t i = 0; i < count; i++)
+	{
+		commandList[i] = (struct writeReg) {
+			.send = 0 | (I2cTransactionOption_All << 6),
+			.sendLength = sizeof(commandList[i].sendData),
+			.sendData = { regs[i], vals[i] },
+		};
+	}
+
+	return I2cExecuteCommandList(dev, NULL, 0, commandList, count * sizeof(commandList[0]));
+}
+
+Result I2cWriteRegHandler8(u8 reg, u8 val, I2cDevice dev)
+{
+	return I2cWriteRegsHandler8(&reg, &val, 1, dev);
+}
+
+#endif
@@ -24,26 +24,46 @@
 #define __TMP451_H_
 
 //#include <utils/types.h>
-#include "i2c.h"
+#include "fanbackend.h"
 
 //#define TMP451_I2C_ADDR 0x4C
 
 #define TMP451_PCB_TEMP_REG    0x00
 #define TMP451_SOC_TEMP_REG    0x01
 
-/*
+#define TMP451_CNV_RATE_READ_REG 0x04
+
 #define TMP451_CONFIG_REG      0x09
 #define TMP451_CNV_RATE_REG    0x0A
-*/
+
+// Conversion rate codes, 0.0625 Hz doubling up to 16 Hz (0x08 and above)
+#define TMP451_CNV_RATE_0_0625HZ 0x00
+#define TMP451_CNV_RATE_8HZ      0x07
+#define TMP451_CNV_RATE_SLOWEST_PERIOD 16000000000ULL // ns, at 0.0625 Hz
 
 #define TMP451_SOC_TEMP_DEC_REG 0x10
 #define TMP451_PCB_TEMP_DEC_REG 0x15
 
+// SOC (remote) offset, not limits
 /*
 #define TMP451_SOC_TMP_OFH_REG 0x11
 #define TMP451_SOC_TMP_OFL_REG 0x12
 */
 
+#define TMP451_STATUS_REG      0x02
+#define TMP451_STATUS_SOC_HIGH (1 << 4)
+#define TMP451_STATUS_SOC_LOW  (1 << 3)
+#define TMP451_STATUS_SOC_OPEN (1 << 2)
+
+// SOC (remote) limits: integer byte has separate read/write pointers,
+// fraction byte (upper nibble, 0.0625 oC steps) is read/write at one address
+#define TMP451_SOC_TMP_HI_READ_REG 0x07
+#define TMP451_SOC_TMP_LO_READ_REG 0x08
+#define TMP451_SOC_TMP_HI_REG      0x0D
+#define TMP451_SOC_TMP_LO_REG      0x0E
+#define TMP451_SOC_TMP_HI_DEC_REG  0x13
+#define TMP451_SOC_TMP_LO_DEC_REG  0x14
+
 // If input is false, the return value is packed. MSByte is the integer in oC
 // and the LSByte is the decimal point truncated to 2 decimal places.
 // Otherwise it's an integer oC.
@@ -54,10 +74,11 @@ void tmp451_init();
 void tmp451_end();
 */
 
+// Register access goes through the active backend's sensor, counted per transaction
 Result Tmp451ReadReg(u8 reg, u8 *out)
 {
 	u8 data = 0;
-	Result res = I2cReadRegHandler8(reg, I2cDevice_Tmp451, &data);
+	Result res = FanBackendSensorReadRegs(&reg, 1, &data);
 
 	if (R_FAILED(res))
 	{
@@ -68,36 +89,123 @@ Result Tmp451ReadReg(u8 reg, u8 *out)
 	return res;
 }
 
+Result Tmp451WriteReg(u8 reg, u8 val)
+{
+	return FanBackendSensorWriteRegs(&reg, &val, 1);
+}
+
+Result Tmp451ReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+	return FanBackendSensorReadRegs(regs, count, out);
+}
+
+// Integer register plus the fraction register's upper nibble (0.0625 oC steps),
+// with the fraction truncated to 2 decimal places
+float Tmp451DecodeTemp(u8 integer, u8 decimals)
+{
+    decimals = ((u16)(decimals >> 4) * 625) / 100;
+    return (float)(integer) + ((float)(decimals) / 100);
+}
+
 Result Tmp451GetSocTemp(float* temperature) {
-    u8 integer = 0;
-    u8 decimals = 0;
+    const u8 regs[] = { TMP451_SOC_TEMP_REG, TMP451_SOC_TEMP_DEC_REG };
+    u8 vals[2] = {0};
 
-    Result rc = Tmp451ReadReg(TMP451_SOC_TEMP_REG, &integer);
-    if (R_FAILED(rc))
-        return rc;
-    rc = Tmp451ReadReg(TMP451_SOC_TEMP_DEC_REG, &decimals);
+    // Both bytes in one transaction so the integer and fraction can't tear
+    Result rc = Tmp451ReadRegs(regs, 2, vals);
     if (R_FAILED(rc))
         return rc;
-    
-    decimals = ((u16)(decimals >> 4) * 625) / 100;
-    *temperature = (float)(integer) + ((float)(decimals) / 100);
+
+    *temperature = Tmp451DecodeTemp(vals[0], vals[1]);
     return rc;
 }
 
 Result Tmp451GetPcbTemp(float* temperature) {
-    u8 integer = 0;
-    u8 decimals = 0;
+    const u8 regs[] = { TMP451_PCB_TEMP_REG, TMP451_PCB_TEMP_DEC_REG };
+    u8 vals[2] = {0};
 
-    Result rc = Tmp451ReadReg(TMP451_PCB_TEMP_REG, &integer);
+    Result rc = Tmp451ReadRegs(regs, 2, vals);
     if (R_FAILED(rc))
         return rc;
-    rc = Tmp451ReadReg(TMP451_PCB_TEMP_DEC_REG, &decimals);
+
+    *temperature = Tmp451DecodeTemp(vals[0], vals[1]);
+    return rc;
+}
+
+typedef struct
+{
+    float   socTemp;
+    float   pcbTemp;
+    u64     tick;       // Backend tick right after the transaction
+} Tmp451Snapshot;
+
+// Reads both sensors' integer and fraction registers in a single transaction
+Result Tmp451GetSnapshot(Tmp451Snapshot* snapshot) {
+    const u8 regs[] = { TMP451_SOC_TEMP_REG, TMP451_SOC_TEMP_DEC_REG, TMP451_PCB_TEMP_REG, TMP451_PCB_TEMP_DEC_REG };
+    u8 vals[4] = {0};
+
+    Result rc = Tmp451ReadRegs(regs, 4, vals);
     if (R_FAILED(rc))
         return rc;
-    
-    decimals = ((u16)(decimals >> 4) * 625) / 100;
-    *temperature = (float)(integer) + ((float)(decimals) / 100);
+
+    snapshot->tick = FanControllerGetBackend()->getTick();
+    snapshot->socTemp = Tmp451DecodeTemp(vals[0], vals[1]);
+    snapshot->pcbTemp = Tmp451DecodeTemp(vals[2], vals[3]);
     return rc;
 }
 
+Result Tmp451GetConversionRate(u8* rate) {
+    return Tmp451ReadReg(TMP451_CNV_RATE_READ_REG, rate);
+}
+
+Result Tmp451SetConversionRate(u8 rate) {
+    return Tmp451WriteReg(TMP451_CNV_RATE_REG, rate);
+}
+
+// Slowest rate that still converts at least twice per sampling interval,
+// so a read never returns a result older than half an interval
+u8 Tmp451ConversionRateForInterval(u64 intervalNs) {
+    u8 rate = TMP451_CNV_RATE_0_0625HZ;
+
+    while (rate < TMP451_CNV_RATE_8HZ && (TMP451_CNV_RATE_SLOWEST_PERIOD >> rate) > intervalNs / 2)
+        rate++;
+
+    return rate;
+}
+
+Result Tmp451GetStatus(u8* status) {
+    return Tmp451ReadReg(TMP451_STATUS_REG, status);
+}
+
+// Raw limit bytes in register order: high, high fraction, low, low fraction
+Result Tmp451GetSocLimitsRaw(u8* raw) {
+    const u8 regs[] = { TMP451_SOC_TMP_HI_READ_REG, TMP451_SOC_TMP_HI_DEC_REG, TMP451_SOC_TMP_LO_READ_REG, TMP451_SOC_TMP_LO_DEC_REG };
+    return Tmp451ReadRegs(regs, 4, raw);
+}
+
+Result Tmp451SetSocLimitsRaw(const u8* raw) {
+    const u8 regs[] = { TMP451_SOC_TMP_HI_REG, TMP451_SOC_TMP_HI_DEC_REG, TMP451_SOC_TMP_LO_REG, TMP451_SOC_TMP_LO_DEC_REG };
+    return FanBackendSensorWriteRegs(regs, raw, 4);
+}
+
+// Encodes a limit as integer byte plus fraction nibble, clamped to the standard range
+void Tmp451EncodeLimit(float temperature, u8* integer, u8* decimals) {
+    int sixteenths = (int)(temperature * 16.0f + 0.5f);
+    if (sixteenths < 0)
+        sixteenths = 0;
+    if (sixteenths > 127 * 16 + 15)
+        sixteenths = 127 * 16 + 15;
+
+    *integer = (u8)(sixteenths >> 4);
+    *decimals = (u8)((sixteenths & 0xF) << 4);
+}
+
+// Status bits latch until read, so a crossing between two reads is not lost
+Result Tmp451SetSocLimits(float low, float high) {
+    u8 raw[4];
+    Tmp451EncodeLimit(high, &raw[0], &raw[1]);
+    Tmp451EncodeLimit(low, &raw[2], &raw[3]);
+    return Tmp451SetSocLimitsRaw(raw);
+}
+
 #endif /* __TMP451_H_ */
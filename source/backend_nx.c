@@ -0,0 +1,80 @@
+#include "fanbackend.h"
+#include "i2c.h"
+
+//libnx backend: TMP451 over the cached I2C session, the pcv fan controller,
+//the system tick and the applet focus state
+static FanController nxFanController;
+
+static Result NxSensorReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+    return I2cReadRegsHandler8(regs, count, I2cDevice_Tmp451, out);
+}
+
+static Result NxSensorWriteRegs(const u8 *regs, const u8 *vals, size_t count)
+{
+    return I2cWriteRegsHandler8(regs, vals, count, I2cDevice_Tmp451);
+}
+
+static void NxSensorClose()
+{
+    I2cCloseSessionCache();
+}
+
+static void NxSensorGetSessionStats(u32 *opens, u32 *reopens, u32 *savedOpens)
+{
+    I2cSessionCacheStats stats;
+    I2cGetSessionCacheStats(&stats);
+
+    *opens = stats.opens;
+    *reopens = stats.reopens;
+    *savedOpens = stats.savedOpens;
+}
+
+static Result NxFanOpen()
+{
+    return fanOpenController(&nxFanController, 0x3D000001);
+}
+
+static Result NxFanSetLevel(float level)
+{
+    return fanControllerSetRotationSpeedLevel(&nxFanController, level);
+}
+
+static Result NxFanGetLevel(float *level)
+{
+    return fanControllerGetRotationSpeedLevel(&nxFanController, level);
+}
+
+static void NxFanClose()
+{
+    fanControllerClose(&nxFanController);
+}
+
+static void NxWaitForWakeup(Event *event, u64 timeoutNs)
+{
+    if (event) {
+        eventWait(event, timeoutNs);
+    } else {
+        svcSleepThread(timeoutNs);
+    }
+}
+
+static bool NxIsInFocus()
+{
+    return appletGetFocusState() == AppletFocusState_InFocus;
+}
+
+const FanControllerBackend fanControllerDefaultBackend = {
+    .sensorReadRegs = NxSensorReadRegs,
+    .sensorWriteRegs = NxSensorWriteRegs,
+    .sensorClose = NxSensorClose,
+    .sensorGetSessionStats = NxSensorGetSessionStats,
+    .fanOpen = NxFanOpen,
+    .fanSetLevel = NxFanSetLevel,
+    .fanGetLevel = NxFanGetLevel,
+    .fanClose = NxFanClose,
+    .getTick = armGetSystemTick,
+    .getTickFrequency = armGetSystemTickFreq,
+    .waitForWakeup = NxWaitForWakeup,
+    .isInFocus = NxIsInFocus,
+};
@@ -1,4 +1,8 @@
+#include <stdarg.h>
+#include <stdatomic.h>
+
 #include "fancontrol.h"
+#include "log.h"
 #include "tmp451.h"
 
 //Fan curve table
@@ -12,6 +16,48 @@ const TemperaturePoint defaultTable[] =
 };
 
 TemperaturePoint *fanControllerTable;
+static FanControllerOptions fanControllerOptions;
+static const FanControllerBackend *fanControllerBackend = &fanControllerDefaultBackend;
+
+//Compiled curve: fan level sampled every 1/16 oC (TMP451 fractional resolution)
+#define FAN_CURVE_LUT_STEPS_PER_C 16
+#define FAN_CURVE_LUT_MAX_C       128
+#define FAN_CURVE_LUT_SIZE        (FAN_CURVE_LUT_MAX_C * FAN_CURVE_LUT_STEPS_PER_C + 1)
+
+typedef struct
+{
+    u32                 pointCount;
+    TemperaturePoint    points[FAN_CURVE_MAX_POINTS];
+    float               lut[FAN_CURVE_LUT_SIZE];
+} CompiledFanCurve;
+
+//One curve per sensor. PCB is optional and only used when fused.
+typedef enum
+{
+    FanCurveSensor_Soc = 0,
+    FanCurveSensor_Pcb = 1,
+    FanCurveSensor_Count,
+} FanCurveSensor;
+
+//Double-buffered curves: readers pin the active slot with a reference count,
+//publishers fill the other slot once its last reader is gone and swap
+static CompiledFanCurve fanCurves[FanCurveSensor_Count][2];
+static _Atomic(CompiledFanCurve *) activeFanCurves[FanCurveSensor_Count];
+static atomic_uint fanCurveReaders[FanCurveSensor_Count][2];
+static Mutex fanCurvePublishMutex;
+
+#define FAN_CURVE_DRAIN_SLEEP 100000ULL // 100 us, long enough for any priority to run
+
+//Telemetry ring, single producer: slot sequence is odd while a sample is
+//being written and 2 * (index + 1) once sample index is complete
+typedef struct
+{
+    atomic_ullong       sequence;
+    FanControllerSample sample;
+} TelemetrySlot;
+
+static TelemetrySlot telemetryRing[FAN_TELEMETRY_RING_SIZE];
+static atomic_ullong telemetryHead = 0; // Samples published so far
 
 //Fan control state
 Thread FanControllerThread;
@@ -23,27 +69,199 @@ volatile bool thermalEmergency = false;
 static u64 currentSleepTime = 30000000000ULL; // Start with 30 seconds
 static float lastTemperature = 0;
 static float lastFanLevel = 0;
+static float lastWrittenFanLevel = -1.0f; // Nothing written yet
 static u32 stableReadings = 0;
 
-//Power state monitoring
-Event powerStateEvent;
-bool powerStateEventInitialized = false;
+//PID state, reset on every init
+static float pidIntegral = 0;
+static float pidLastTemperature = 0;
+static u64 pidLastTick = 0;
+static bool pidPrimed = false;
+
+//Feed-forward: filtered SOC slope, reset on every init
+#define FEED_FORWARD_MAX_LEAD 10.0f // oC the curve may be evaluated ahead
+static float filteredSlope = 0;
+static float slopeLastTemperature = 0;
+static u64 slopeLastTick = 0;
+static bool slopePrimed = false;
+
+//Hysteresis operating point, reset on every init
+static float hysteresisTemperature = 0;
+static bool hysteresisPrimed = false;
+
+//Slew limiter: level actually commanded while ramping towards the target
+#define RAMP_STEP_INTERVAL 1000000000ULL // 1 second between ramp steps
+static float slewedFanLevel = 0;
+static u64 slewLastTick = 0;
+static bool slewPrimed = false;
+
+//Sensor fusion: last PCB reading, refreshed every pcbSampleInterval
+static float pcbTemperature = 0;
+static u64 pcbSampleTick = 0;
+static bool pcbSampled = false;
+
+//Fan readback: the level the fan service reports is compared against the
+//last one written, and a fan that runs without cooling is treated as stalled
+#define FAN_READBACK_INTERVAL 60000000000ULL  // 1 minute
+#define FAN_STALL_MIN_LEVEL   0.5f            // Only watched while clearly commanded
+#define FAN_STALL_WINDOW      120000000000ULL // 2 minutes, well past the SOC's time constant
+#define FAN_STALL_WINDOWS     2               // Consecutive rising windows before a stall is declared
+#define FAN_STALL_TEMP_RISE   5.0f            // oC within each window
+#define FAN_STALL_RECOVERY    1.0f            // oC below the peak that shows the fan cooling again
+#define FAN_STALL_HOLD        600000000000ULL // 10 minutes, then the watch starts over
+static u64 fanReadbackTick = 0;
+static bool fanReadbackPrimed = false;
+static bool stallWatchActive = false;
+static u64 stallWatchTick = 0;
+static float stallWatchTemperature = 0;
+static float stallWatchFanLevel = 0;
+static u32 stallRisingWindows = 0;
+static bool fanStalled = false;
+static u64 fanStalledTick = 0;
+static float fanStalledPeak = 0;
+
+//Sensor filter chain state, one entry per stage, reset on every init
+typedef struct
+{
+    float   history[SENSOR_FILTER_MAX_MEDIAN];
+    u32     historyCount;
+    u32     historyNext;
+    float   estimate;
+    float   variance;
+    bool    primed;
+} SensorFilterState;
+
+static SensorFilterState sensorFilterStates[SENSOR_FILTER_MAX_STAGES];
+
+//Sensor conversion rate, programmed from the sampling interval
+#define CONVERSION_RATE_UNSET 0xFF
+static u8 conversionRate = CONVERSION_RATE_UNSET;
+static u8 originalConversionRate = CONVERSION_RATE_UNSET;
+
+//Threshold wakeups: SOC limits armed around the current curve segment
+#define SOC_LOW_LIMIT_MARGIN 0.0625f    // One sensor step, the low alert also fires at the limit
+static bool limitsArmed = false;
+static bool originalLimitsValid = false;
+static u8 originalLimits[4];
+
+//Wake event: the controller waits on it instead of sleeping, so shutdown,
+//curve changes and emergencies take effect immediately
+Event wakeEvent;
+bool wakeEventInitialized = false;
+volatile bool wakeRequested = false;
 
 //Thermal thresholds for emergency response
 #define EMERGENCY_TEMP_THRESHOLD 80.0f
 #define CRITICAL_TEMP_THRESHOLD 90.0f
 #define TEMP_CHANGE_THRESHOLD 2.0f
 #define STABLE_READINGS_FOR_SLOWDOWN 10
+#define FAN_UPDATE_DELTA 0.02f
 
 //Sleep intervals (nanoseconds)
 #define MIN_SLEEP_INTERVAL    1000000000ULL   // 1 second (emergency)
 #define NORMAL_SLEEP_INTERVAL 10000000000ULL  // 10 seconds (active)
 #define LONG_SLEEP_INTERVAL   30000000000ULL  // 30 seconds (stable)
 #define SLEEP_MODE_INTERVAL   300000000000ULL // 5 minutes (sleep mode)
+#define THRESHOLD_SLEEP_INTERVAL 120000000000ULL // 2 minutes (SOC limits armed)
 
 //Log
 char logPath[PATH_MAX];
 
+//Binary log: records batch up in memory and are appended to LOG_FILE when the
+//batch fills, on an emergency sample, or when the writer exits
+#define LOG_BATCH_RECORDS 32
+static FanLogRecord logBatch[LOG_BATCH_RECORDS];
+static u32 logBatchCount = 0;
+static bool logInitialized = false;
+
+//Async log sink: producers push into bounded lock-free queues and only the
+//writer thread touches storage. Each cell carries a sequence number, stored
+//relative to its index so the zeroed queue is already initialized and
+//messages logged before the writer starts are kept.
+#define LOG_QUEUE_SIZE 128 // Power of two, several batches deep
+#define LOG_MESSAGE_QUEUE_SIZE 16
+#define LOG_MESSAGE_LENGTH 96
+
+typedef struct
+{
+    atomic_size_t  *sequences;
+    size_t          size;
+    atomic_size_t   enqueuePos;
+    size_t          dequeuePos; // Writer thread only
+} LogQueue;
+
+typedef struct
+{
+    u64     tick;
+    int     level;
+    char    text[LOG_MESSAGE_LENGTH];
+} LogMessage;
+
+static atomic_size_t logRecordSequences[LOG_QUEUE_SIZE];
+static FanLogRecord logRecords[LOG_QUEUE_SIZE];
+static LogQueue logRecordQueue = { .sequences = logRecordSequences, .size = LOG_QUEUE_SIZE };
+
+static atomic_size_t logMessageSequences[LOG_MESSAGE_QUEUE_SIZE];
+static LogMessage logMessages[LOG_MESSAGE_QUEUE_SIZE];
+static LogQueue logMessageQueue = { .sequences = logMessageSequences, .size = LOG_MESSAGE_QUEUE_SIZE };
+
+static atomic_uint logRecordsQueued;
+static atomic_uint logRecordsDropped;
+static u64 logStartTick = 0;
+
+Thread logWriterThread;
+Event logWriterEvent;
+bool logWriterRunning = false;
+static atomic_bool logWriterExit = false;
+
+//Accounting for FanControllerGetStats, never reset. Relaxed increments are
+//enough: readers only need each counter to be untorn and monotonic.
+static atomic_ullong statLoopIterations;
+static atomic_ullong statI2cTransactions;
+static atomic_ullong statI2cFailures;
+static atomic_ullong statFanWrites;
+static atomic_ullong statFanWritesSkipped;
+static atomic_ullong statSleepTimeNs[FanSleepTier_Count];
+
+#define STAT_ADD(counter, value) atomic_fetch_add_explicit(&(counter), (value), memory_order_relaxed)
+
+void FanControllerSetBackend(const FanControllerBackend *backend)
+{
+    fanControllerBackend = backend ? backend : &fanControllerDefaultBackend;
+}
+
+const FanControllerBackend *FanControllerGetBackend()
+{
+    return fanControllerBackend;
+}
+
+// Split so a long uptime can't overflow the multiplication
+u64 FanBackendTicksToNs(u64 ticks)
+{
+    u64 frequency = fanControllerBackend->getTickFrequency();
+    return (ticks / frequency) * 1000000000ULL + (ticks % frequency) * 1000000000ULL / frequency;
+}
+
+Result FanBackendSensorReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+    Result rc = fanControllerBackend->sensorReadRegs(regs, count, out);
+
+    STAT_ADD(statI2cTransactions, 1);
+    if (R_FAILED(rc))
+        STAT_ADD(statI2cFailures, 1);
+    return rc;
+}
+
+Result FanBackendSensorWriteRegs(const u8 *regs, const u8 *vals, size_t count)
+{
+    Result rc = fanControllerBackend->sensorWriteRegs(regs, vals, count);
+
+    STAT_ADD(statI2cTransactions, 1);
+    if (R_FAILED(rc))
+        STAT_ADD(statI2cFailures, 1);
+    return rc;
+}
+
 void CreateDir(char *dir)
 {
     if (!dir) return;
@@ -71,124 +289,484 @@ void CreateDir(char *dir)
     }
 }
 
-void InitLog()
+// Starts LOG_FILE over with a fresh header; false if it couldn't be written
+bool WriteLogHeader()
 {
     if(access(LOG_DIR, F_OK) == -1)
         CreateDir(LOG_DIR);
 
-    // Don't remove existing log, just truncate on first write
-    FILE *log = fopen(LOG_FILE, "w");
+    FanLogHeader header = {
+        .magic = FANLOG_MAGIC,
+        .version = FANLOG_VERSION,
+        .recordSize = sizeof(FanLogRecord),
+        .tickFrequency = fanControllerBackend->getTickFrequency(),
+        .startTick = logStartTick,
+    };
+
+    FILE *log = fopen(LOG_FILE, "wb");
+    if (!log)
+        return false;
+
+    fwrite(&header, sizeof(header), 1, log);
+    fclose(log);
+    return true;
+}
+
+// Start fresh logs on every init. Record and message times are relative to
+// this tick, so it is taken here rather than when the first batch is flushed.
+void InitLog()
+{
+    logStartTick = fanControllerBackend->getTick();
+    logInitialized = WriteLogHeader();
+
+    FILE *log = fopen(LOG_TEXT_FILE, "w");
     if (log) {
-        fprintf(log, "Fan Controller Started - Ultra Optimized Version\n");
         fclose(log);
     }
 }
 
-//void WriteLog(const char *buffer)
-//{
-//    if (!buffer) return;
-//    
-//    FILE *log = fopen(LOG_FILE, "a");
-//    if(log != NULL)
-//    {
-//        time_t now;
-//        time(&now);
-//        struct tm *timeinfo = localtime(&now);
-//        
-//        fprintf(log, "[%02d:%02d:%02d] %s\n", 
-//                timeinfo->tm_hour, timeinfo->tm_min, timeinfo->tm_sec, buffer);
-//        fclose(log);
-//    }
-//}
+void FlushLog()
+{
+    if (logBatchCount == 0) return;
+
+    // Only when the header couldn't be written at init, the start tick stays
+    if (!logInitialized)
+        logInitialized = WriteLogHeader();
 
-void WriteConfigFile(TemperaturePoint *table)
+    FILE *log = fopen(LOG_FILE, "ab");
+    if (log) {
+        fwrite(logBatch, sizeof(FanLogRecord), logBatchCount, log);
+        fclose(log);
+    }
+
+    // Dropped on failure rather than growing without bound
+    logBatchCount = 0;
+}
+
+// Never blocks: returns false when the queue is full
+bool LogQueueClaim(LogQueue *queue, size_t *pos_out)
+{
+    size_t pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+
+    while (true) {
+        size_t slot = pos & (queue->size - 1);
+        size_t sequence = atomic_load_explicit(&queue->sequences[slot], memory_order_acquire) + slot;
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueuePos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *pos_out = pos;
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&queue->enqueuePos, memory_order_relaxed);
+        }
+    }
+}
+
+void LogQueuePublish(LogQueue *queue, size_t pos)
+{
+    size_t slot = pos & (queue->size - 1);
+    atomic_store_explicit(&queue->sequences[slot], pos + 1 - slot, memory_order_release);
+}
+
+// Writer thread only: slot of the oldest published entry, if any
+bool LogQueuePeek(LogQueue *queue, size_t *slot_out)
 {
-    TemperaturePoint *tableToWrite = table;
+    size_t slot = queue->dequeuePos & (queue->size - 1);
+    size_t sequence = atomic_load_explicit(&queue->sequences[slot], memory_order_acquire) + slot;
+
+    if (sequence != queue->dequeuePos + 1)
+        return false;
+
+    *slot_out = slot;
+    return true;
+}
+
+void LogQueuePop(LogQueue *queue)
+{
+    size_t slot = queue->dequeuePos & (queue->size - 1);
+    atomic_store_explicit(&queue->sequences[slot], queue->dequeuePos + queue->size - slot, memory_order_release);
+    queue->dequeuePos++;
+}
+
+// A full queue drops the record and counts it
+bool EnqueueLogRecord(const FanLogRecord *record, bool flushNow)
+{
+    size_t pos;
+
+    if (!LogQueueClaim(&logRecordQueue, &pos)) {
+        atomic_fetch_add_explicit(&logRecordsDropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    logRecords[pos & (LOG_QUEUE_SIZE - 1)] = *record;
+    LogQueuePublish(&logRecordQueue, pos);
+    atomic_fetch_add_explicit(&logRecordsQueued, 1, memory_order_relaxed);
+
+    // Wake the writer once per batch, or right away when it has to hit storage
+    if (logWriterRunning && (flushNow || (pos + 1) % LOG_BATCH_RECORDS == 0))
+        eventFire(&logWriterEvent);
+
+    return true;
+}
+
+void DrainLogQueue()
+{
+    bool flushNeeded = false;
+    size_t slot;
+
+    while (LogQueuePeek(&logRecordQueue, &slot)) {
+        logBatch[logBatchCount++] = logRecords[slot];
+        LogQueuePop(&logRecordQueue);
+
+        if (logBatch[logBatchCount - 1].flags & FAN_SAMPLE_FLAG_EMERGENCY)
+            flushNeeded = true;
+        if (logBatchCount == LOG_BATCH_RECORDS)
+            FlushLog();
+    }
+
+    if (flushNeeded)
+        FlushLog();
+}
+
+void DrainMessageQueue()
+{
+    static const char *levelNames[] = { "NONE", "ERROR", "WARN", "INFO", "DEBUG" };
+    size_t slot;
+
+    if (!LogQueuePeek(&logMessageQueue, &slot))
+        return;
+
+    FILE *log = fopen(LOG_TEXT_FILE, "a");
+
+    do {
+        LogMessage *message = &logMessages[slot];
+        if (log) {
+            // Messages from before InitLog come out negative rather than wrapped
+            double seconds = (double)(s64)(message->tick - logStartTick) / fanControllerBackend->getTickFrequency();
+            fprintf(log, "[%10.3f] %s: %s\n", seconds, levelNames[message->level], message->text);
+        }
+        LogQueuePop(&logMessageQueue);
+    } while (LogQueuePeek(&logMessageQueue, &slot));
+
+    if (log)
+        fclose(log);
+}
+
+// Only reached through the LOG_* macros, whose disabled levels compile away
+void WriteLog(int level, const char *format, ...)
+{
+    size_t pos;
+
+    if (level <= LOG_LEVEL_NONE || level > LOG_LEVEL_DEBUG)
+        return;
+
+    if (!LogQueueClaim(&logMessageQueue, &pos))
+        return;
+
+    LogMessage *message = &logMessages[pos & (LOG_MESSAGE_QUEUE_SIZE - 1)];
+    message->tick = fanControllerBackend->getTick();
+    message->level = level;
+
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message->text, sizeof(message->text), format, args);
+    va_end(args);
+
+    LogQueuePublish(&logMessageQueue, pos);
+
+    WakeLogWriter();
+}
+
+void WakeLogWriter()
+{
+    if (logWriterRunning)
+        eventFire(&logWriterEvent);
+}
+
+void LogWriterThreadFunction(void* arg)
+{
+    (void)arg;
+
+    while (!logWriterExit) {
+        DrainMessageQueue();
+        DrainLogQueue();
+        FanTraceWriteBuffers();
+        eventWait(&logWriterEvent, UINT64_MAX);
+    }
+
+    DrainMessageQueue();
+    DrainLogQueue();
+    FlushLog();
+    FanTraceWriteBuffers();
+}
+
+void InitLogWriter()
+{
+    if (logWriterRunning) return;
+
+    InitLog();
+    logWriterExit = false;
+
+    if (R_FAILED(eventCreate(&logWriterEvent, true)))
+        return;
+
+    // Same lowest priority as the controller, so storage never preempts it
+    Result rs = threadCreate(&logWriterThread, LogWriterThreadFunction, NULL, NULL, 0x2000, 0x3F, -2);
+    if (R_FAILED(rs)) {
+        eventClose(&logWriterEvent);
+        return;
+    }
+
+    rs = threadStart(&logWriterThread);
+    if (R_FAILED(rs)) {
+        threadClose(&logWriterThread);
+        eventClose(&logWriterEvent);
+        return;
+    }
+
+    logWriterRunning = true;
+}
+
+void CloseLogWriter()
+{
+    if (!logWriterRunning) return;
+
+    logWriterExit = true;
+    eventFire(&logWriterEvent);
+    threadWaitForExit(&logWriterThread);
+    threadClose(&logWriterThread);
+    eventClose(&logWriterEvent);
+    logWriterRunning = false;
+}
+
+void LogSample(const FanControllerSample *sample)
+{
+    FanLogRecord record = {
+        .tick = sample->tick,
+        .socTemp = (s16)lrintf(sample->socTemp * 100.0f),
+        .pcbTemp = (s16)lrintf(sample->pcbTemp * 100.0f),
+        .fanLevel = (u16)lrintf(fminf(fmaxf(sample->fanLevel, 0.0f), 1.0f) * 10000.0f),
+        .flags = (u8)sample->flags,
+        .type = FANLOG_RECORD_SAMPLE,
+    };
+
+    // Emergencies go to storage right away in case the console shuts down
+    EnqueueLogRecord(&record, sample->flags & FAN_SAMPLE_FLAG_EMERGENCY);
+}
+
+void FanControllerGetLogStats(u32 *queued, u32 *dropped)
+{
+    if (queued) *queued = atomic_load_explicit(&logRecordsQueued, memory_order_relaxed);
+    if (dropped) *dropped = atomic_load_explicit(&logRecordsDropped, memory_order_relaxed);
+}
+
+void FanControllerGetStats(FanControllerStats *stats)
+{
+    if (!stats) return;
+
+    stats->loopIterations = atomic_load_explicit(&statLoopIterations, memory_order_relaxed);
+    stats->i2cTransactions = atomic_load_explicit(&statI2cTransactions, memory_order_relaxed);
+    stats->i2cFailures = atomic_load_explicit(&statI2cFailures, memory_order_relaxed);
+    stats->fanWrites = atomic_load_explicit(&statFanWrites, memory_order_relaxed);
+    stats->fanWritesSkipped = atomic_load_explicit(&statFanWritesSkipped, memory_order_relaxed);
+    for (int i = 0; i < FanSleepTier_Count; i++) {
+        stats->sleepTimeNs[i] = atomic_load_explicit(&statSleepTimeNs[i], memory_order_relaxed);
+    }
+}
+
+//Config file: header followed by pointCount points. Files written before
+//curves had a length are exactly DEFAULT_POINT_COUNT bare points
+#define CONFIG_MAGIC 0x56524346 // "FCRV"
+#define DEFAULT_POINT_COUNT (sizeof(defaultTable) / sizeof(TemperaturePoint))
+
+typedef struct
+{
+    u32     magic;
+    u32     pointCount;
+} ConfigHeader;
+
+// Binary search and the 0 to first point segment need a sorted, positive curve
+bool ValidateFanCurve(const TemperaturePoint *table, u32 pointCount)
+{
+    if (!table || pointCount < FAN_CURVE_MIN_POINTS || pointCount > FAN_CURVE_MAX_POINTS)
+        return false;
+
+    if (table->temperature_c <= 0)
+        return false;
+
+    for (u32 i = 1; i < pointCount; i++) {
+        if (table[i].temperature_c <= table[i - 1].temperature_c)
+            return false;
+    }
+
+    return true;
+}
+
+void WriteConfigFile(TemperaturePoint *table, u32 pointCount)
+{
+    const TemperaturePoint *tableToWrite = table;
     
     if(tableToWrite == NULL)
     {
-        tableToWrite = malloc(sizeof(defaultTable));
-        if (!tableToWrite) return;
-        memcpy(tableToWrite, defaultTable, sizeof(defaultTable));
+        tableToWrite = defaultTable;
+        pointCount = DEFAULT_POINT_COUNT;
+    }
+
+    if (!ValidateFanCurve(tableToWrite, pointCount)) {
+        LOG_ERROR("Refusing to write invalid fan curve");
+        return;
     }
 
     if(access(CONFIG_DIR, F_OK) == -1)
         CreateDir(CONFIG_DIR);
 
+    ConfigHeader header = { .magic = CONFIG_MAGIC, .pointCount = pointCount };
+
     FILE *config = fopen(CONFIG_FILE, "wb");
     if (config) {
-        fwrite(tableToWrite, sizeof(defaultTable), 1, config);
+        fwrite(&header, sizeof(header), 1, config);
+        fwrite(tableToWrite, sizeof(TemperaturePoint), pointCount, config);
         fclose(config);
     }
-    
-    if (table == NULL) {
-        free(tableToWrite);
-    }
 }
 
-void ReadConfigFile(TemperaturePoint **table_out)
+// Returns a malloc'd curve read from an open config file, NULL if unusable
+TemperaturePoint *ReadConfigCurve(FILE *config, u32 *pointCount_out)
 {
-    if (!table_out) return;
-    
-    InitLog();
+    ConfigHeader header;
+    u32 pointCount = DEFAULT_POINT_COUNT;
 
-    *table_out = malloc(sizeof(defaultTable));
-    if (!*table_out) {
-        //WriteLog("Memory allocation failed");
-        return;
+    if (fread(&header, sizeof(header), 1, config) == 1 && header.magic == CONFIG_MAGIC) {
+        pointCount = header.pointCount;
+        if (pointCount < FAN_CURVE_MIN_POINTS || pointCount > FAN_CURVE_MAX_POINTS)
+            return NULL;
+    } else {
+        rewind(config); // Headerless file from before variable-length curves
     }
-    
-    memcpy(*table_out, defaultTable, sizeof(defaultTable));
+
+    TemperaturePoint *table = malloc(pointCount * sizeof(TemperaturePoint));
+    if (!table)
+        return NULL;
+
+    if (fread(table, sizeof(TemperaturePoint), pointCount, config) != pointCount ||
+        !ValidateFanCurve(table, pointCount)) {
+        free(table);
+        return NULL;
+    }
+
+    *pointCount_out = pointCount;
+    return table;
+}
+
+void ReadConfigFile(TemperaturePoint **table_out, u32 *pointCount_out)
+{
+    if (!table_out || !pointCount_out) return;
+
+    *table_out = NULL;
+    *pointCount_out = 0;
 
     if(access(CONFIG_DIR, F_OK) == -1)
     {
         CreateDir(CONFIG_DIR);
-        WriteConfigFile(NULL);
-        //WriteLog("Created missing config directory");
+        WriteConfigFile(NULL, 0);
+        LOG_INFO("Created missing config directory");
     }
     else
     {
         if(access(CONFIG_FILE, F_OK) == -1)
         {
-            WriteConfigFile(NULL);
-            //WriteLog("Created missing config file");
+            WriteConfigFile(NULL, 0);
+            LOG_INFO("Created missing config file");
         }
         else
         {
             FILE *config = fopen(CONFIG_FILE, "rb");
             if (config) {
-                size_t bytesRead = fread(*table_out, sizeof(defaultTable), 1, config);
+                *table_out = ReadConfigCurve(config, pointCount_out);
                 fclose(config);
                 
-                if (bytesRead == 1) {
-                    //WriteLog("Config file loaded successfully");
+                if (*table_out) {
+                    LOG_INFO("Config file loaded successfully (%u points)", *pointCount_out);
                 } else {
-                    //WriteLog("Config file corrupted, using defaults");
-                    memcpy(*table_out, defaultTable, sizeof(defaultTable));
+                    LOG_WARN("Config file corrupted, using defaults");
                 }
             }
         }
-    }    
+    }
+
+    if (*table_out == NULL) {
+        *table_out = malloc(sizeof(defaultTable));
+        if (!*table_out) {
+            LOG_ERROR("Memory allocation failed");
+            return;
+        }
+
+        memcpy(*table_out, defaultTable, sizeof(defaultTable));
+        *pointCount_out = DEFAULT_POINT_COUNT;
+    }
 }
 
-// Power state monitoring functions
-void InitPowerStateMonitoring()
+// Wake event functions
+void InitWakeEvent()
 {
-    // Initialize power state event monitoring if available
-    Result rs = eventCreate(&powerStateEvent, true);
+    if (wakeEventInitialized) return;
+
+    Result rs = eventCreate(&wakeEvent, true);
     if (R_SUCCEEDED(rs)) {
-        powerStateEventInitialized = true;
-        //WriteLog("Power state monitoring initialized");
+        wakeEventInitialized = true;
+        LOG_DEBUG("Wake event initialized");
     } else {
-        //WriteLog("Power state monitoring unavailable");
+        LOG_WARN("Wake event unavailable (0x%x), falling back to plain sleeps", rs);
+    }
+}
+
+void CloseWakeEvent()
+{
+    if (wakeEventInitialized) {
+        eventClose(&wakeEvent);
+        wakeEventInitialized = false;
+    }
+}
+
+// Every interval the controller picks maps onto one of these
+FanSleepTier SleepTierForInterval(u64 timeout)
+{
+    if (timeout <= MIN_SLEEP_INTERVAL)          return FanSleepTier_1s;
+    if (timeout <= MIN_SLEEP_INTERVAL * 2)      return FanSleepTier_2s;
+    if (timeout <= NORMAL_SLEEP_INTERVAL / 2)   return FanSleepTier_5s;
+    if (timeout <= NORMAL_SLEEP_INTERVAL)       return FanSleepTier_10s;
+    if (timeout <= LONG_SLEEP_INTERVAL)         return FanSleepTier_30s;
+    if (timeout <= THRESHOLD_SLEEP_INTERVAL)    return FanSleepTier_120s;
+    return FanSleepTier_300s;
+}
+
+// Sleeps for up to timeout nanoseconds, returning early when woken
+void WaitForWakeup(u64 timeout)
+{
+    u64 start = fanControllerBackend->getTick();
+    fanControllerBackend->waitForWakeup(wakeEventInitialized ? &wakeEvent : NULL, timeout);
+    u64 slept = FanBackendTicksToNs(fanControllerBackend->getTick() - start);
+
+    STAT_ADD(statSleepTimeNs[SleepTierForInterval(timeout)], slept);
+}
+
+void WakeFanController()
+{
+    wakeRequested = true;
+
+    if (wakeEventInitialized) {
+        eventFire(&wakeEvent);
     }
 }
 
 bool CheckSystemSleepState() {
     static bool wasFocused = true;
     
-    AppletFocusState focusState = appletGetFocusState();
-    bool isCurrentlyFocused = (focusState == AppletFocusState_InFocus);
+    bool isCurrentlyFocused = fanControllerBackend->isInFocus();
     
     // If we lost focus, assume system went to sleep
     if (wasFocused && !isCurrentlyFocused) {
@@ -202,53 +780,232 @@ bool CheckSystemSleepState() {
     return !isCurrentlyFocused;
 }
 
-float CalculateFanLevel(float temperatureC_f)
+// Lock-free: only retries when a publish swapped the slot under us
+const CompiledFanCurve *AcquireFanCurve(FanCurveSensor sensor)
 {
-    if (!fanControllerTable) return 0.0f;
-    
+    while (true) {
+        CompiledFanCurve *curve = atomic_load(&activeFanCurves[sensor]);
+        if (!curve) return NULL;
+
+        atomic_uint *readers = &fanCurveReaders[sensor][curve - fanCurves[sensor]];
+        atomic_fetch_add(readers, 1);
+        if (atomic_load(&activeFanCurves[sensor]) == curve) return curve;
+        atomic_fetch_sub(readers, 1);
+    }
+}
+
+void ReleaseFanCurve(FanCurveSensor sensor, const CompiledFanCurve *curve)
+{
+    atomic_fetch_sub(&fanCurveReaders[sensor][curve - fanCurves[sensor]], 1);
+}
+
+// Index of the segment [i, i + 1] containing a temperature strictly between
+// the first and last points
+u32 FindFanCurveSegment(const CompiledFanCurve *curve, float temperatureC_f)
+{
+    u32 low = 0;
+    u32 high = curve->pointCount - 1;
+
+    while (high - low > 1) {
+        u32 mid = low + (high - low) / 2;
+        if (curve->points[mid].temperature_c <= temperatureC_f) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+// Reference interpolation straight from the points, used to build the lookup table
+float EvaluateFanCurve(const CompiledFanCurve *curve, float temperatureC_f)
+{
+    const TemperaturePoint *first = curve->points;
+    const TemperaturePoint *last = curve->points + curve->pointCount - 1;
+
     // Handle edge cases
     if (temperatureC_f <= 0) return 0.0f;
-    if (temperatureC_f <= fanControllerTable->temperature_c) {
+    if (temperatureC_f <= first->temperature_c) {
         // Linear interpolation from 0 to first point
-        float m = fanControllerTable->fanLevel_f / fanControllerTable->temperature_c;
+        float m = first->fanLevel_f / first->temperature_c;
         return m * temperatureC_f;
     }
     
     // Check if above maximum temperature
-    if (temperatureC_f >= (fanControllerTable + 4)->temperature_c) {
-        return (fanControllerTable + 4)->fanLevel_f;
+    if (temperatureC_f >= last->temperature_c) {
+        return last->fanLevel_f;
     }
     
     // Find the correct temperature range and interpolate
-    for(int i = 0; i < (TABLE_SIZE/sizeof(TemperaturePoint)) - 1; i++)
-    {
-        TemperaturePoint *current = fanControllerTable + i;
-        TemperaturePoint *next = fanControllerTable + i + 1;
-        
-        if(temperatureC_f >= current->temperature_c && temperatureC_f <= next->temperature_c)
-        {
-            float tempDiff = next->temperature_c - current->temperature_c;
-            if (tempDiff <= 0) return current->fanLevel_f; // Avoid division by zero
-            
-            float m = (next->fanLevel_f - current->fanLevel_f) / tempDiff;
-            float q = current->fanLevel_f - (m * current->temperature_c);
-            
-            return (m * temperatureC_f) + q;
-        }
+    const TemperaturePoint *current = curve->points + FindFanCurveSegment(curve, temperatureC_f);
+    const TemperaturePoint *next = current + 1;
+
+    float tempDiff = next->temperature_c - current->temperature_c;
+    float m = (next->fanLevel_f - current->fanLevel_f) / tempDiff;
+    float q = current->fanLevel_f - (m * current->temperature_c);
+
+    return (m * temperatureC_f) + q;
+}
+
+void CompileFanCurve(CompiledFanCurve *curve, const TemperaturePoint *table, u32 pointCount)
+{
+    curve->pointCount = pointCount;
+    memcpy(curve->points, table, pointCount * sizeof(TemperaturePoint));
+
+    for (int i = 0; i < FAN_CURVE_LUT_SIZE; i++) {
+        curve->lut[i] = EvaluateFanCurve(curve, (float)i / FAN_CURVE_LUT_STEPS_PER_C);
     }
-    
-    return 0.0f; // Fallback
 }
 
-u64 CalculateAdaptiveSleepTime(float currentTemp, float fanLevel)
+// Breakpoints are whole degrees and so fall on table entries, which keeps the
+// lerp between neighbouring entries exact
+float LookupFanLevel(const CompiledFanCurve *curve, float temperatureC_f)
+{
+    if (temperatureC_f <= 0) return 0.0f;
+
+    float position = temperatureC_f * FAN_CURVE_LUT_STEPS_PER_C;
+    if (position >= FAN_CURVE_LUT_SIZE - 1) return EvaluateFanCurve(curve, temperatureC_f);
+
+    u32 index = (u32)position;
+    float fraction = position - index;
+    return curve->lut[index] + (curve->lut[index + 1] - curve->lut[index]) * fraction;
+}
+
+float CalculateSensorFanLevel(FanCurveSensor sensor, float temperatureC_f)
+{
+    const CompiledFanCurve *curve = AcquireFanCurve(sensor);
+    if (!curve) return 0.0f;
+
+    float fanLevel = LookupFanLevel(curve, temperatureC_f);
+    ReleaseFanCurve(sensor, curve);
+    return fanLevel;
+}
+
+float CalculateFanLevel(float temperatureC_f)
+{
+    return CalculateSensorFanLevel(FanCurveSensor_Soc, temperatureC_f);
+}
+
+bool PublishFanCurve(FanCurveSensor sensor, const TemperaturePoint *table, u32 pointCount)
+{
+    if (!ValidateFanCurve(table, pointCount)) {
+        LOG_ERROR("Invalid fan curve update (%u points)", pointCount);
+        return false;
+    }
+
+    mutexLock(&fanCurvePublishMutex);
+
+    CompiledFanCurve *active = atomic_load(&activeFanCurves[sensor]);
+    CompiledFanCurve *target = (active == &fanCurves[sensor][0]) ? &fanCurves[sensor][1] : &fanCurves[sensor][0];
+
+    // Readers only ever pin a slot for one lookup, so this drains quickly. A
+    // zero sleep would only yield to equal priorities, and the controller
+    // thread pinning the slot may be preempted at a lower one on this core.
+    while (atomic_load(&fanCurveReaders[sensor][target - fanCurves[sensor]]) != 0) {
+        svcSleepThread(FAN_CURVE_DRAIN_SLEEP);
+    }
+
+    CompileFanCurve(target, table, pointCount);
+    atomic_store(&activeFanCurves[sensor], target);
+
+    mutexUnlock(&fanCurvePublishMutex);
+
+    WakeFanController();
+    return true;
+}
+
+bool FanControllerSetCurve(const TemperaturePoint *table, u32 pointCount)
+{
+    return PublishFanCurve(FanCurveSensor_Soc, table, pointCount);
+}
+
+bool FanControllerSetPcbCurve(const TemperaturePoint *table, u32 pointCount)
+{
+    return PublishFanCurve(FanCurveSensor_Pcb, table, pointCount);
+}
+
+void PublishSample(const FanControllerSample *sample)
+{
+    u64 index = atomic_load_explicit(&telemetryHead, memory_order_relaxed);
+    TelemetrySlot *slot = &telemetryRing[index % FAN_TELEMETRY_RING_SIZE];
+
+    atomic_store_explicit(&slot->sequence, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->sample = *sample;
+    atomic_store_explicit(&slot->sequence, 2 * (index + 1), memory_order_release);
+    atomic_store_explicit(&telemetryHead, index + 1, memory_order_release);
+}
+
+// Copies samples from *cursor onwards and advances it. A reader that fell more
+// than a ring behind skips ahead to the oldest sample still held.
+size_t FanControllerReadSamples(u64 *cursor, FanControllerSample *out, size_t maxSamples)
+{
+    if (!cursor || !out) return 0;
+
+    u64 head = atomic_load_explicit(&telemetryHead, memory_order_acquire);
+    if (head - *cursor > FAN_TELEMETRY_RING_SIZE || *cursor > head)
+        *cursor = head > FAN_TELEMETRY_RING_SIZE ? head - FAN_TELEMETRY_RING_SIZE : 0;
+
+    size_t count = 0;
+    while (count < maxSamples && *cursor < head) {
+        u64 index = *cursor;
+        TelemetrySlot *slot = &telemetryRing[index % FAN_TELEMETRY_RING_SIZE];
+
+        u64 before = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        out[count] = slot->sample;
+        atomic_thread_fence(memory_order_acquire);
+        u64 after = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
+
+        (*cursor)++;
+        if (before == 2 * (index + 1) && after == before)
+            count++; // Otherwise overwritten while copying, drop it
+    }
+
+    return count;
+}
+
+// Bounds and slope of the curve segment containing the temperature
+bool GetFanCurveSegment(float temperatureC_f, float *lowC_f, float *highC_f, float *slope)
+{
+    const CompiledFanCurve *curve = AcquireFanCurve(FanCurveSensor_Soc);
+    if (!curve) return false;
+
+    const TemperaturePoint *first = curve->points;
+    const TemperaturePoint *last = curve->points + curve->pointCount - 1;
+
+    if (temperatureC_f <= first->temperature_c) {
+        *lowC_f = 0;
+        *highC_f = first->temperature_c;
+        *slope = first->fanLevel_f / first->temperature_c;
+    } else if (temperatureC_f >= last->temperature_c) {
+        *lowC_f = last->temperature_c;
+        *highC_f = CRITICAL_TEMP_THRESHOLD;
+        *slope = 0;
+    } else {
+        const TemperaturePoint *current = curve->points + FindFanCurveSegment(curve, temperatureC_f);
+        const TemperaturePoint *next = current + 1;
+
+        *lowC_f = current->temperature_c;
+        *highC_f = next->temperature_c;
+        *slope = (next->fanLevel_f - current->fanLevel_f) / (next->temperature_c - current->temperature_c);
+    }
+
+    ReleaseFanCurve(FanCurveSensor_Soc, curve);
+    return true;
+}
+
+// peakTemp is the hotter of the raw and filtered readings: a lagging filter
+// must not delay an emergency, stability is judged on the filtered one
+u64 CalculateAdaptiveSleepTime(float currentTemp, float peakTemp, float fanLevel)
 {
     // Emergency response for high temperatures
-    if (currentTemp >= CRITICAL_TEMP_THRESHOLD) {
+    if (peakTemp >= CRITICAL_TEMP_THRESHOLD) {
         thermalEmergency = true;
         return MIN_SLEEP_INTERVAL; // 1 second
     }
     
-    if (currentTemp >= EMERGENCY_TEMP_THRESHOLD) {
+    if (peakTemp >= EMERGENCY_TEMP_THRESHOLD) {
         thermalEmergency = true;
         return MIN_SLEEP_INTERVAL * 2; // 2 seconds
     }
@@ -280,100 +1037,651 @@ u64 CalculateAdaptiveSleepTime(float currentTemp, float fanLevel)
     }
 }
 
+// Derivative acts on the measurement so setpoint changes don't kick the fan.
+// Anti-windup: the integral only accumulates while the output is unsaturated
+// or the error is pulling it back into range.
+float CalculatePidFanLevel(float temperatureC_f, u64 tick)
+{
+    const PidParameters *pid = &fanControllerOptions.pid;
+    float error = temperatureC_f - pid->setpoint_c;
+    float dt = 0;
+    float derivative = 0;
+
+    if (pidPrimed && tick > pidLastTick) {
+        dt = (float)FanBackendTicksToNs(tick - pidLastTick) / 1e9f;
+        derivative = (temperatureC_f - pidLastTemperature) / dt;
+    }
+
+    float integral = pidIntegral + error * dt;
+    float output = pid->kp * error + pid->ki * integral + pid->kd * derivative;
+
+    if (output > pid->outputMax) {
+        output = pid->outputMax;
+        if (error < 0) pidIntegral = integral;
+    } else if (output < pid->outputMin) {
+        output = pid->outputMin;
+        if (error > 0) pidIntegral = integral;
+    } else {
+        pidIntegral = integral;
+    }
+
+    pidLastTemperature = temperatureC_f;
+    pidLastTick = tick;
+    pidPrimed = true;
+    return output;
+}
+
+// EMA of the SOC slope in oC/s across samples
+float UpdateTemperatureSlope(float temperatureC_f, u64 tick)
+{
+    if (slopePrimed && tick > slopeLastTick) {
+        float dt = (float)FanBackendTicksToNs(tick - slopeLastTick) / 1e9f;
+        float slope = (temperatureC_f - slopeLastTemperature) / dt;
+        filteredSlope += fanControllerOptions.feedForwardSmoothing * (slope - filteredSlope);
+    }
+
+    slopeLastTemperature = temperatureC_f;
+    slopeLastTick = tick;
+    slopePrimed = true;
+    return filteredSlope;
+}
+
+// Only a rising slope leads the curve; falling temperatures still follow it
+float CalculateFeedForwardLead(float temperatureC_f, u64 tick)
+{
+    float slope = UpdateTemperatureSlope(temperatureC_f, tick);
+    return fminf(fmaxf(slope, 0.0f) * fanControllerOptions.feedForwardLookahead_s, FEED_FORWARD_MAX_LEAD);
+}
+
+// Backlash: a rising temperature moves the operating point at once, a falling
+// one only after dropping hysteresis_c below it, so every breakpoint gets a
+// rising and a falling threshold hysteresis_c apart
+float ApplyHysteresis(float temperatureC_f)
+{
+    float band = fanControllerOptions.hysteresis_c;
+
+    if (!hysteresisPrimed || temperatureC_f > hysteresisTemperature) {
+        hysteresisTemperature = temperatureC_f;
+    } else if (temperatureC_f < hysteresisTemperature - band) {
+        hysteresisTemperature = temperatureC_f + band;
+    }
+
+    hysteresisPrimed = true;
+    return hysteresisTemperature;
+}
+
+float CalculateTableFanLevel(float temperatureC_f, u64 tick)
+{
+    float curveTemperature = temperatureC_f;
+
+    if (fanControllerOptions.feedForwardLookahead_s > 0) {
+        curveTemperature += CalculateFeedForwardLead(temperatureC_f, tick);
+    }
+
+    if (fanControllerOptions.hysteresis_c > 0) {
+        curveTemperature = ApplyHysteresis(curveTemperature);
+    }
+
+    return CalculateFanLevel(curveTemperature);
+}
+
+bool SensorFusionActive()
+{
+    return fanControllerOptions.mode == FanControlMode_Table &&
+           fanControllerOptions.fusion != SensorFusion_SocOnly &&
+           atomic_load(&activeFanCurves[FanCurveSensor_Pcb]) != NULL;
+}
+
+// Combines the SOC curve's level with the PCB curve's, PCB skips the SOC
+// feed-forward and hysteresis since it only drifts slowly
+float FuseSensorFanLevels(float socFanLevel, float pcbTemperatureC_f)
+{
+    float pcbFanLevel = CalculateSensorFanLevel(FanCurveSensor_Pcb, pcbTemperatureC_f);
+
+    if (fanControllerOptions.fusion == SensorFusion_Max) {
+        return fmaxf(socFanLevel, pcbFanLevel);
+    }
+
+    float weight = fminf(fmaxf(fanControllerOptions.pcbWeight, 0.0f), 1.0f);
+    return socFanLevel * (1.0f - weight) + pcbFanLevel * weight;
+}
+
+// Reads the level back from the fan service once per FAN_READBACK_INTERVAL.
+// On a mismatch the cached level is replaced so the next check rewrites it.
+void CheckFanReadback(u64 tick)
+{
+    if (fanReadbackPrimed && FanBackendTicksToNs(tick - fanReadbackTick) < FAN_READBACK_INTERVAL)
+        return;
+
+    fanReadbackTick = tick;
+    fanReadbackPrimed = true;
+
+    float actualFanLevel;
+    Result rs = fanControllerBackend->fanGetLevel(&actualFanLevel);
+    if (R_FAILED(rs)) {
+        LOG_WARN("Failed to read back fan speed (0x%x)", rs);
+        lastWrittenFanLevel = -1.0f;
+        return;
+    }
+
+    if (lastWrittenFanLevel >= 0 && fabs(actualFanLevel - lastWrittenFanLevel) > FAN_UPDATE_DELTA) {
+        LOG_WARN("Fan level drifted: set %.1f%%, read %.1f%%",
+                 lastWrittenFanLevel * 100.0f, actualFanLevel * 100.0f);
+        lastWrittenFanLevel = actualFanLevel;
+    }
+}
+
+// A fan held at one level of FAN_STALL_MIN_LEVEL or more while the SOC climbs
+// FAN_STALL_TEMP_RISE in each of FAN_STALL_WINDOWS consecutive windows is taken
+// as stalled. A load step settles within the first window. The curve raising
+// the level as the SOC heats up keeps the watch going, a lower level or a
+// falling temperature starts it over. The latch clears once the temperature
+// turns back down from its peak, or after FAN_STALL_HOLD to look again.
+bool UpdateStallWatch(float temperatureC_f, u64 tick)
+{
+    if (fanStalled) {
+        fanStalledPeak = fmaxf(fanStalledPeak, temperatureC_f);
+        if (temperatureC_f <= fanStalledPeak - FAN_STALL_RECOVERY) {
+            LOG_INFO("Fan cooling again at %.1f°C", temperatureC_f);
+            fanStalled = false;
+            stallWatchActive = false;
+        } else if (FanBackendTicksToNs(tick - fanStalledTick) >= FAN_STALL_HOLD) {
+            LOG_WARN("Fan stall unresolved at %.1f°C, watching again", temperatureC_f);
+            fanStalled = false;
+            stallWatchActive = false;
+        }
+        return fanStalled;
+    }
+
+    if (lastWrittenFanLevel < FAN_STALL_MIN_LEVEL) {
+        stallWatchActive = false;
+        return false;
+    }
+
+    // Restart when the fan is turned down or shows an effect. A stalled fan
+    // makes a sloped curve raise the level, which mustn't hide the stall.
+    if (!stallWatchActive || lastWrittenFanLevel < stallWatchFanLevel ||
+        temperatureC_f <= stallWatchTemperature) {
+        stallWatchActive = true;
+        stallWatchTick = tick;
+        stallWatchTemperature = temperatureC_f;
+        stallWatchFanLevel = lastWrittenFanLevel;
+        stallRisingWindows = 0;
+        return false;
+    }
+
+    stallWatchFanLevel = lastWrittenFanLevel;
+    if (FanBackendTicksToNs(tick - stallWatchTick) < FAN_STALL_WINDOW)
+        return false;
+
+    if (temperatureC_f - stallWatchTemperature >= FAN_STALL_TEMP_RISE) {
+        stallRisingWindows++;
+    } else {
+        stallRisingWindows = 0;
+    }
+
+    if (stallRisingWindows >= FAN_STALL_WINDOWS) {
+        LOG_ERROR("Fan stall suspected: still %.1f°C -> %.1f°C at %.1f%%, forcing full speed",
+                  stallWatchTemperature, temperatureC_f, lastWrittenFanLevel * 100.0f);
+        fanStalled = true;
+        fanStalledTick = tick;
+        fanStalledPeak = temperatureC_f;
+    }
+
+    // The next window starts where this one ended
+    stallWatchTick = tick;
+    stallWatchTemperature = temperatureC_f;
+    return fanStalled;
+}
+
+// Both sensors in one transaction when the PCB reading is due, else SOC only
+Result ReadSensors(Tmp451Snapshot *snapshot)
+{
+    u64 now = fanControllerBackend->getTick();
+    bool pcbDue = !pcbSampled || FanBackendTicksToNs(now - pcbSampleTick) >= fanControllerOptions.pcbSampleInterval;
+
+    if (pcbDue) {
+        Result rc = Tmp451GetSnapshot(snapshot);
+        if (R_SUCCEEDED(rc)) {
+            pcbTemperature = snapshot->pcbTemp;
+            pcbSampleTick = snapshot->tick;
+            pcbSampled = true;
+        }
+        return rc;
+    }
+
+    Result rc = Tmp451GetSocTemp(&snapshot->socTemp);
+    if (R_FAILED(rc))
+        return rc;
+
+    snapshot->tick = fanControllerBackend->getTick();
+    snapshot->pcbTemp = pcbTemperature;
+    return rc;
+}
+
+// Moves the commanded level towards the target by at most slewRateUp/Down
+// per second. Emergencies, judged on the hotter of the raw and filtered
+// readings, jump straight to the target.
+float ApplySlewRate(float targetFanLevel, float peakTemperatureC_f, u64 tick)
+{
+    float upRate = fanControllerOptions.slewRateUp;
+    float downRate = fanControllerOptions.slewRateDown;
+
+    if (!slewPrimed || peakTemperatureC_f >= EMERGENCY_TEMP_THRESHOLD) {
+        slewedFanLevel = targetFanLevel;
+    } else if (tick > slewLastTick) {
+        float dt = (float)FanBackendTicksToNs(tick - slewLastTick) / 1e9f;
+
+        if (targetFanLevel > slewedFanLevel && upRate > 0) {
+            slewedFanLevel = fminf(targetFanLevel, slewedFanLevel + upRate * dt);
+        } else if (targetFanLevel < slewedFanLevel && downRate > 0) {
+            slewedFanLevel = fmaxf(targetFanLevel, slewedFanLevel - downRate * dt);
+        } else {
+            slewedFanLevel = targetFanLevel;
+        }
+    }
+
+    slewLastTick = tick;
+    slewPrimed = true;
+    return slewedFanLevel;
+}
+
+// The window was made odd and in range by SanitizeSensorFilters
+float ApplyMedianFilter(const SensorFilterStage *stage, SensorFilterState *state, float value)
+{
+    u32 window = stage->medianWindow;
+
+    state->history[state->historyNext] = value;
+    state->historyNext = (state->historyNext + 1) % window;
+    if (state->historyCount < window) state->historyCount++;
+
+    // Insertion sort of at most SENSOR_FILTER_MAX_MEDIAN values
+    float sorted[SENSOR_FILTER_MAX_MEDIAN];
+    for (u32 i = 0; i < state->historyCount; i++) {
+        float v = state->history[i];
+        u32 j = i;
+        while (j > 0 && sorted[j - 1] > v) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+
+    return sorted[state->historyCount / 2];
+}
+
+float ApplyEmaFilter(const SensorFilterStage *stage, SensorFilterState *state, float value)
+{
+    if (!state->primed) {
+        state->estimate = value;
+        state->primed = true;
+    } else {
+        state->estimate += stage->emaAlpha * (value - state->estimate);
+    }
+
+    return state->estimate;
+}
+
+float ApplyKalmanFilter(const SensorFilterStage *stage, SensorFilterState *state, float value)
+{
+    if (!state->primed) {
+        state->estimate = value;
+        state->variance = stage->kalmanMeasurementNoise;
+        state->primed = true;
+        return value;
+    }
+
+    state->variance += stage->kalmanProcessNoise;
+    float gain = state->variance / (state->variance + stage->kalmanMeasurementNoise);
+    state->estimate += gain * (value - state->estimate);
+    state->variance *= 1.0f - gain;
+
+    return state->estimate;
+}
+
+// Clamps each stage's parameters into the ranges documented in fancontrol.h,
+// so no setting can freeze the reading or turn the median into a mean
+void SanitizeSensorFilters(SensorFilterStage *filters)
+{
+    for (int i = 0; i < SENSOR_FILTER_MAX_STAGES; i++) {
+        SensorFilterStage *stage = &filters[i];
+        SensorFilterStage original = *stage;
+
+        if (stage->medianWindow < 3) stage->medianWindow = 3;
+        if (stage->medianWindow > SENSOR_FILTER_MAX_MEDIAN) stage->medianWindow = SENSOR_FILTER_MAX_MEDIAN;
+        if (stage->medianWindow % 2 == 0) stage->medianWindow++;
+
+        // Written so NaN fails the comparisons and gets clamped too
+        if (!(stage->emaAlpha >= SENSOR_FILTER_MIN_EMA_ALPHA)) stage->emaAlpha = SENSOR_FILTER_MIN_EMA_ALPHA;
+        if (!(stage->emaAlpha <= 1.0f)) stage->emaAlpha = 1.0f;
+        if (!(stage->kalmanProcessNoise >= SENSOR_FILTER_MIN_KALMAN_NOISE)) stage->kalmanProcessNoise = SENSOR_FILTER_MIN_KALMAN_NOISE;
+        if (!(stage->kalmanMeasurementNoise >= 0.0f)) stage->kalmanMeasurementNoise = 0.0f;
+
+        bool clamped = (stage->type == SensorFilter_Median && stage->medianWindow != original.medianWindow) ||
+                       (stage->type == SensorFilter_Ema && stage->emaAlpha != original.emaAlpha) ||
+                       (stage->type == SensorFilter_Kalman &&
+                        (stage->kalmanProcessNoise != original.kalmanProcessNoise ||
+                         stage->kalmanMeasurementNoise != original.kalmanMeasurementNoise));
+        if (clamped) {
+            LOG_WARN("Sensor filter stage %d: parameters out of range, clamped", i);
+        }
+    }
+}
+
+float ApplySensorFilters(float temperatureC_f)
+{
+    for (int i = 0; i < SENSOR_FILTER_MAX_STAGES; i++) {
+        const SensorFilterStage *stage = &fanControllerOptions.filters[i];
+        SensorFilterState *state = &sensorFilterStates[i];
+
+        switch (stage->type) {
+            case SensorFilter_Median:
+                temperatureC_f = ApplyMedianFilter(stage, state, temperatureC_f);
+                break;
+            case SensorFilter_Ema:
+                temperatureC_f = ApplyEmaFilter(stage, state, temperatureC_f);
+                break;
+            case SensorFilter_Kalman:
+                temperatureC_f = ApplyKalmanFilter(stage, state, temperatureC_f);
+                break;
+            default:
+                return temperatureC_f;
+        }
+    }
+
+    return temperatureC_f;
+}
+
+// Reprograms the TMP451 only when the interval moves to a different rate tier
+void UpdateConversionRate(u64 sleepTime)
+{
+    u8 rate = Tmp451ConversionRateForInterval(sleepTime);
+    if (rate == conversionRate)
+        return;
+
+    Result rs = Tmp451SetConversionRate(rate);
+    if (R_FAILED(rs)) {
+        LOG_ERROR("Failed to set conversion rate (0x%x)", rs);
+        conversionRate = CONVERSION_RATE_UNSET; // Retry next iteration
+        return;
+    }
+
+    conversionRate = rate;
+}
+
+// Programs the SOC limits to the window in which neither the fan level would
+// change by more than FAN_UPDATE_DELTA nor the reading stop counting as stable
+bool ArmSocLimits(float temperatureC_f)
+{
+    float segmentLow, segmentHigh, slope;
+    float band = TEMP_CHANGE_THRESHOLD;
+    u8 status = 0;
+
+    if (!GetFanCurveSegment(temperatureC_f, &segmentLow, &segmentHigh, &slope))
+        return false;
+
+    if (!originalLimitsValid) {
+        if (R_FAILED(Tmp451GetSocLimitsRaw(originalLimits)))
+            return false;
+        originalLimitsValid = true;
+    }
+
+    if (slope > 0 && FAN_UPDATE_DELTA / slope < band)
+        band = FAN_UPDATE_DELTA / slope;
+
+    // On a curve point the segment starts at the reading itself, which would
+    // alert at once
+    float low = fminf(fmaxf(temperatureC_f - band, segmentLow), temperatureC_f - SOC_LOW_LIMIT_MARGIN);
+    float high = fminf(fminf(temperatureC_f + band, segmentHigh), EMERGENCY_TEMP_THRESHOLD);
+
+    if (R_FAILED(Tmp451SetSocLimits(low, high)))
+        return false;
+
+    // Clear whatever latched under the previous limits
+    if (R_FAILED(Tmp451GetStatus(&status)))
+        return false;
+
+    return true;
+}
+
+// True while no SOC limit crossing has latched since the last check
+bool SocLimitsQuiet()
+{
+    u8 status = 0;
+
+    if (R_FAILED(Tmp451GetStatus(&status)))
+        return false;
+
+    return !(status & (TMP451_STATUS_SOC_HIGH | TMP451_STATUS_SOC_LOW | TMP451_STATUS_SOC_OPEN));
+}
+
 void FanControllerThreadFunction(void* arg)
 {
     (void)arg; // Suppress unused parameter warning
     
-    FanController fc;
+    Tmp451Snapshot snapshot;
     float fanLevelSet_f = 0;
     float temperatureC_f = 0;
-    char logBuffer[256];
 
-    Result rs = fanOpenController(&fc, 0x3D000001);
+    Result rs = fanControllerBackend->fanOpen();
     if(R_FAILED(rs))
     {
-        //WriteLog("ERROR: Failed to open fan controller");
+        LOG_ERROR("Failed to open fan controller (0x%x)", rs);
         diagAbortWithResult(MAKERESULT(Module_Libnx, LibnxError_ShouldNotHappen));
         return;
     }
 
-    //WriteLog("Fan controller thread started");
-    
-    // Initialize power state monitoring
-    InitPowerStateMonitoring();
+    LOG_INFO("Fan controller thread started");
+
+    // Remember the rate the system configured so it can be restored on exit
+    conversionRate = CONVERSION_RATE_UNSET;
+    if (R_FAILED(Tmp451GetConversionRate(&originalConversionRate)))
+        originalConversionRate = CONVERSION_RATE_UNSET;
 
     while(!fanControllerThreadExit)
     {
+        // An explicit wake always gets a full sample
+        bool woken = wakeRequested;
+        wakeRequested = false;
+        STAT_ADD(statLoopIterations, 1);
+
         // Check system sleep state
         systemInSleepMode = CheckSystemSleepState();
+
+        // With limits armed only the status byte is read until something crosses.
+        // The Switch routes no ALERT interrupt to us, but the status bits latch
+        // a crossing at every conversion, so the poll can be far apart.
+        if (limitsArmed) {
+            if (!woken && !systemInSleepMode && SocLimitsQuiet()) {
+                WaitForWakeup(THRESHOLD_SLEEP_INTERVAL);
+                continue;
+            }
+            limitsArmed = false;
+        }
         
-        // Get current temperature
-        rs = Tmp451GetSocTemp(&temperatureC_f);
+        // Get current temperatures, PCB only as often as pcbSampleInterval allows
+        rs = ReadSensors(&snapshot);
         if(R_FAILED(rs))
         {
-            //WriteLog("ERROR: Failed to get temperature");
+            LOG_ERROR("Failed to get temperature (0x%x)", rs);
             // Don't abort on temperature read failure, try again later
-            svcSleepThread(NORMAL_SLEEP_INTERVAL);
+            WaitForWakeup(NORMAL_SLEEP_INTERVAL);
             continue;
         }
+        temperatureC_f = ApplySensorFilters(snapshot.socTemp);
+        float peakTemperatureC_f = fmaxf(snapshot.socTemp, temperatureC_f);
 
         // Calculate required fan level
-        fanLevelSet_f = CalculateFanLevel(temperatureC_f);
+        if (fanControllerOptions.mode == FanControlMode_Pid) {
+            fanLevelSet_f = CalculatePidFanLevel(temperatureC_f, snapshot.tick);
+        } else {
+            fanLevelSet_f = CalculateTableFanLevel(temperatureC_f, snapshot.tick);
+            if (SensorFusionActive()) {
+                fanLevelSet_f = FuseSensorFanLevels(fanLevelSet_f, snapshot.pcbTemp);
+            }
+        }
+
+        float targetFanLevel_f = fanLevelSet_f;
+        if (fanControllerOptions.slewRateUp > 0 || fanControllerOptions.slewRateDown > 0) {
+            fanLevelSet_f = ApplySlewRate(targetFanLevel_f, peakTemperatureC_f, snapshot.tick);
+        }
+        bool ramping = fanLevelSet_f != targetFanLevel_f;
+
+        CheckFanReadback(snapshot.tick);
+        if (UpdateStallWatch(temperatureC_f, snapshot.tick)) {
+            fanLevelSet_f = 1.0f;
+        }
         
         // Only update fan if there's a significant change or it's been a while
         bool shouldUpdateFan = false;
         
         if (thermalEmergency) {
             shouldUpdateFan = true; // Always update in emergency
-        } else if (fabs(fanLevelSet_f - lastFanLevel) > 0.02f) {
+        } else if (fabs(fanLevelSet_f - lastWrittenFanLevel) > FAN_UPDATE_DELTA) {
             shouldUpdateFan = true; // Update if fan level changed significantly
         } else if (systemInSleepMode && fanLevelSet_f > 0.1f) {
             shouldUpdateFan = true; // Ensure fan runs if needed during sleep
         }
         
+        bool fanWritten = false;
         if (shouldUpdateFan) {
-            rs = fanControllerSetRotationSpeedLevel(&fc, fanLevelSet_f);
+            rs = fanControllerBackend->fanSetLevel(fanLevelSet_f);
             if(R_FAILED(rs))
             {
-                //WriteLog("ERROR: Failed to set fan speed");
+                LOG_ERROR("Failed to set fan speed (0x%x)", rs);
                 // Continue operation even if fan control fails
             } else {
-                snprintf(logBuffer, sizeof(logBuffer), 
-                        "Temp: %.1f°C, Fan: %.1f%%, Sleep: %s", 
-                        temperatureC_f, fanLevelSet_f * 100.0f,
-                        systemInSleepMode ? "Yes" : "No");
-                //WriteLog(logBuffer);
+                fanWritten = true;
+                STAT_ADD(statFanWrites, 1);
+                lastWrittenFanLevel = fanLevelSet_f;
+                LOG_DEBUG("Temp: %.1f°C, Fan: %.1f%%, Sleep: %s",
+                          temperatureC_f, fanLevelSet_f * 100.0f,
+                          systemInSleepMode ? "Yes" : "No");
             }
+        } else {
+            STAT_ADD(statFanWritesSkipped, 1);
         }
         
         // Calculate adaptive sleep time
-        currentSleepTime = CalculateAdaptiveSleepTime(temperatureC_f, fanLevelSet_f);
+        currentSleepTime = CalculateAdaptiveSleepTime(temperatureC_f, peakTemperatureC_f, fanLevelSet_f);
+
+        // Once stable, hand the watch over to the sensor's limit comparators.
+        // Those only watch SOC, so a fused PCB curve keeps the controller polling.
+        if (fanControllerOptions.thresholdWakeups && fanControllerOptions.mode == FanControlMode_Table &&
+            !SensorFusionActive() && currentSleepTime == LONG_SLEEP_INTERVAL && !ramping && !fanStalled) {
+            limitsArmed = ArmSocLimits(temperatureC_f);
+            if (limitsArmed) {
+                currentSleepTime = THRESHOLD_SLEEP_INTERVAL;
+            }
+        }
+
+        // Short steps only until the ramp settles, then back to the adaptive interval
+        if (ramping && currentSleepTime > RAMP_STEP_INTERVAL) {
+            currentSleepTime = RAMP_STEP_INTERVAL;
+        }
+
+        UpdateConversionRate(currentSleepTime);
+
+        FanControllerSample sample = {
+            .tick = snapshot.tick,
+            .socTemp = snapshot.socTemp,
+            .pcbTemp = snapshot.pcbTemp,
+            .fanLevel = fanLevelSet_f,
+            .flags = (thermalEmergency ? FAN_SAMPLE_FLAG_EMERGENCY : 0) |
+                     (systemInSleepMode ? FAN_SAMPLE_FLAG_SLEEP_MODE : 0) |
+                     (fanWritten ? FAN_SAMPLE_FLAG_FAN_WRITTEN : 0) |
+                     (limitsArmed ? FAN_SAMPLE_FLAG_LIMITS_ARMED : 0) |
+                     (fanStalled ? FAN_SAMPLE_FLAG_FAN_STALLED : 0),
+            .sleepTime = currentSleepTime,
+        };
+        PublishSample(&sample);
+
+        if (fanControllerOptions.binaryLog) {
+            LogSample(&sample);
+        }
+
+        // The reads that led up to an emergency reach storage with it
+        if (thermalEmergency) {
+            FanTraceFlush();
+        }
         
         // Store current values for next iteration
         lastTemperature = temperatureC_f;
         lastFanLevel = fanLevelSet_f;
         
         // Sleep for calculated duration
-        svcSleepThread(currentSleepTime);
+        WaitForWakeup(currentSleepTime);
     }
 
     // Cleanup
-    if (powerStateEventInitialized) {
-        eventClose(&powerStateEvent);
+    if (originalLimitsValid) {
+        Tmp451SetSocLimitsRaw(originalLimits);
+        originalLimitsValid = false;
     }
-    
-    fanControllerClose(&fc);
-    //WriteLog("Fan controller thread stopped");
+    limitsArmed = false;
+
+    if (originalConversionRate != CONVERSION_RATE_UNSET && conversionRate != originalConversionRate) {
+        Tmp451SetConversionRate(originalConversionRate);
+    }
+
+    fanControllerBackend->sensorClose();
+    fanControllerBackend->fanClose();
+    LOG_INFO("Fan controller thread stopped");
+}
+
+void GetDefaultFanControllerOptions(FanControllerOptions *options)
+{
+    if (!options) return;
+
+    memset(options, 0, sizeof(*options));
+    options->thresholdWakeups = false;
+    options->binaryLog = true;
+    options->sensorTrace = false;
+    options->mode = FanControlMode_Table;
+    options->pid.setpoint_c = 55.0f;
+    options->pid.kp = 0.05f;
+    options->pid.ki = 0.001f;
+    options->pid.kd = 0.0f;
+    options->pid.outputMin = 0.0f;
+    options->pid.outputMax = 1.0f;
+    options->feedForwardLookahead_s = 0.0f;
+    options->feedForwardSmoothing = 0.3f;
+    options->hysteresis_c = 0.0f;
+    options->slewRateUp = 0.0f;
+    options->slewRateDown = 0.0f;
+    for (int i = 0; i < SENSOR_FILTER_MAX_STAGES; i++) {
+        options->filters[i].type = SensorFilter_None;
+        options->filters[i].medianWindow = 3;
+        options->filters[i].emaAlpha = 0.5f;
+        options->filters[i].kalmanProcessNoise = 0.05f;
+        options->filters[i].kalmanMeasurementNoise = 0.5f;
+    }
+    options->fusion = SensorFusion_SocOnly;
+    options->pcbWeight = 0.5f;
+    options->pcbSampleInterval = LONG_SLEEP_INTERVAL;
+}
+
+void InitFanController(TemperaturePoint *table, u32 pointCount)
+{
+    InitFanControllerWithOptions(table, pointCount, NULL);
 }
 
-void InitFanController(TemperaturePoint *table)
+void InitFanControllerWithOptions(TemperaturePoint *table, u32 pointCount, const FanControllerOptions *options)
 {
-    if (!table) {
-        //WriteLog("ERROR: Invalid fan control table");
+    if (!ValidateFanCurve(table, pointCount)) {
+        LOG_ERROR("Invalid fan control table");
         return;
     }
     
     fanControllerTable = table;
+    FanControllerSetCurve(table, pointCount);
+
+    if (options) {
+        fanControllerOptions = *options;
+    } else {
+        GetDefaultFanControllerOptions(&fanControllerOptions);
+    }
+    SanitizeSensorFilters(fanControllerOptions.filters);
 
     // Reset state variables
     fanControllerThreadExit = false;
@@ -382,15 +1690,42 @@ void InitFanController(TemperaturePoint *table)
     currentSleepTime = LONG_SLEEP_INTERVAL;
     lastTemperature = 0;
     lastFanLevel = 0;
+    lastWrittenFanLevel = -1.0f;
     stableReadings = 0;
+    limitsArmed = false;
+    wakeRequested = false;
+    pidIntegral = 0;
+    pidPrimed = false;
+    filteredSlope = 0;
+    slopePrimed = false;
+    hysteresisPrimed = false;
+    slewPrimed = false;
+    pcbSampled = false;
+    fanReadbackPrimed = false;
+    stallWatchActive = false;
+    fanStalled = false;
+    memset(sensorFilterStates, 0, sizeof(sensorFilterStates));
+
+    // Created before the thread so a close right after init can always wake it
+    InitWakeEvent();
+
+    // Text messages and the sensor trace go through the writer too, whether
+    // or not samples are logged
+    if (fanControllerOptions.binaryLog || fanControllerOptions.sensorTrace || LOG_LEVEL > LOG_LEVEL_NONE) {
+        InitLogWriter();
+    }
+
+    if (fanControllerOptions.sensorTrace) {
+        FanTraceStart(TRACE_FILE);
+    }
 
     Result rs = threadCreate(&FanControllerThread, FanControllerThreadFunction, NULL, NULL, 0x4000, 0x3F, -2);
     if(R_FAILED(rs))
     {
-        //WriteLog("ERROR: Failed to create fan controller thread");
+        LOG_ERROR("Failed to create fan controller thread (0x%x)", rs);
         diagAbortWithResult(MAKERESULT(Module_Libnx, LibnxError_ShouldNotHappen));
     } else {
-        //WriteLog("Fan controller thread created successfully");
+        LOG_DEBUG("Fan controller thread created successfully");
     }
 }
 
@@ -399,27 +1734,33 @@ void StartFanControllerThread()
     Result rs = threadStart(&FanControllerThread);
     if(R_FAILED(rs))
     {
-        //WriteLog("ERROR: Failed to start fan controller thread");
+        LOG_ERROR("Failed to start fan controller thread (0x%x)", rs);
         diagAbortWithResult(MAKERESULT(Module_Libnx, LibnxError_ShouldNotHappen));
     } else {
-        //WriteLog("Fan controller thread started successfully");
+        LOG_DEBUG("Fan controller thread started successfully");
     }
 }
 
 void CloseFanControllerThread()
 {   
-    //WriteLog("Shutting down fan controller thread...");
+    LOG_INFO("Shutting down fan controller thread...");
     
     fanControllerThreadExit = true;
+    WakeFanController();
     
     Result rs = threadWaitForExit(&FanControllerThread);
     if(R_FAILED(rs))
     {
-        //WriteLog("ERROR: Failed to wait for thread exit");
+        LOG_ERROR("Failed to wait for thread exit (0x%x)", rs);
         // Continue with cleanup anyway
     }
     
     threadClose(&FanControllerThread);
+    CloseWakeEvent();
+    CloseLogWriter();
+    if (fanControllerOptions.sensorTrace) {
+        FanTraceStop();
+    }
     
     // Reset state
     fanControllerThreadExit = false;
@@ -431,8 +1772,25 @@ void CloseFanControllerThread()
         free(fanControllerTable);
         fanControllerTable = NULL;
     }
+    for (int i = 0; i < FanCurveSensor_Count; i++) {
+        atomic_store(&activeFanCurves[i], NULL);
+    }
     
-    //WriteLog("Fan controller shutdown complete");
+    LOG_INFO("Fan controller shutdown complete");
+}
+
+void FanControllerGetI2cSessionStats(u32 *opens, u32 *reopens, u32 *savedOpens)
+{
+    u32 sessionOpens = 0;
+    u32 sessionReopens = 0;
+    u32 sessionSavedOpens = 0;
+
+    if (fanControllerBackend->sensorGetSessionStats)
+        fanControllerBackend->sensorGetSessionStats(&sessionOpens, &sessionReopens, &sessionSavedOpens);
+
+    if (opens) *opens = sessionOpens;
+    if (reopens) *reopens = sessionReopens;
+    if (savedOpens) *savedOpens = sessionSavedOpens;
 }
 
 void WaitFanController()
@@ -440,7 +1798,7 @@ void WaitFanController()
     Result rs = threadWaitForExit(&FanControllerThread);
     if(R_FAILED(rs))
     {
-        //WriteLog("ERROR: Failed to wait for fan controller thread");
+        LOG_ERROR("Failed to wait for fan controller thread (0x%x)", rs);
         diagAbortWithResult(MAKERESULT(Module_Libnx, LibnxError_ShouldNotHappen));
     }
 }
@@ -0,0 +1,210 @@
+#include <stdatomic.h>
+
+#include "fancontrol.h"
+#include "fantrace.h"
+#include "log.h"
+
+//Sensor trace recorder: a backend that forwards to the one active at start
+//and appends every successful sensor read, failed read and focus change to a
+//trace file. Records fill one of FANTRACE_BUFFER_COUNT buffers on the
+//controller thread, which hands it to the log writer thread when it fills,
+//on an emergency sample, or once it has held records for
+//FANTRACE_FLUSH_INTERVAL. Only the writer touches the file while it runs.
+#define FANTRACE_BUFFER_SIZE 4096
+#define FANTRACE_BUFFER_COUNT 4                     // Power of two
+#define FANTRACE_FLUSH_INTERVAL 60000000000ULL      // 1 minute
+
+typedef struct
+{
+    u8      data[FANTRACE_BUFFER_SIZE];
+    size_t  used;
+} TraceBuffer;
+
+static const FanControllerBackend *traceInner = NULL;
+static FanControllerBackend traceBackend;
+static FILE *traceFile = NULL;
+static Mutex traceFileMutex;
+static TraceBuffer traceBuffers[FANTRACE_BUFFER_COUNT];
+static atomic_uint traceBuffersFilled;      // Handed over by the controller thread
+static atomic_uint traceBuffersWritten;     // Written out, the buffer is free again
+static u64 traceBufferStartTick = 0;        // First record in the buffer being filled
+static u8 traceDropped[FANTRACE_MAX_RECORD_SIZE];
+static u32 traceRecordsDropped = 0;
+static u64 traceLastTick = 0;
+static bool traceFocusKnown = false;
+static bool traceLastFocus = false;
+
+// The buffer being filled, NULL while every one waits for storage
+static TraceBuffer *CurrentTraceBuffer()
+{
+    unsigned filled = atomic_load_explicit(&traceBuffersFilled, memory_order_relaxed);
+
+    if (filled - atomic_load_explicit(&traceBuffersWritten, memory_order_acquire) >= FANTRACE_BUFFER_COUNT)
+        return NULL;
+    return &traceBuffers[filled & (FANTRACE_BUFFER_COUNT - 1)];
+}
+
+// Controller thread: hands whatever is buffered to the log writer
+void FanTraceFlush()
+{
+    TraceBuffer *buffer = CurrentTraceBuffer();
+
+    if (!buffer || buffer->used == 0)
+        return;
+
+    atomic_fetch_add_explicit(&traceBuffersFilled, 1, memory_order_release);
+    WakeLogWriter();
+}
+
+// Log writer thread, or FanTraceStop once the writer has exited
+void FanTraceWriteBuffers()
+{
+    mutexLock(&traceFileMutex);
+
+    unsigned written = atomic_load_explicit(&traceBuffersWritten, memory_order_relaxed);
+    while (written != atomic_load_explicit(&traceBuffersFilled, memory_order_acquire)) {
+        TraceBuffer *buffer = &traceBuffers[written & (FANTRACE_BUFFER_COUNT - 1)];
+
+        if (traceFile) {
+            fwrite(buffer->data, 1, buffer->used, traceFile);
+            fflush(traceFile);
+        }
+        buffer->used = 0;
+        atomic_store_explicit(&traceBuffersWritten, ++written, memory_order_release);
+    }
+
+    mutexUnlock(&traceFileMutex);
+}
+
+// Returns where the payload goes, after the type byte and tick delta
+u8 *BeginTraceRecord(u8 type, size_t payloadSize)
+{
+    u64 tick = traceInner->getTick();
+    TraceBuffer *buffer = CurrentTraceBuffer();
+
+    if (buffer && buffer->used > 0 &&
+        (buffer->used + FANTRACE_MAX_RECORD_SIZE > FANTRACE_BUFFER_SIZE ||
+         FanBackendTicksToNs(tick - traceBufferStartTick) >= FANTRACE_FLUSH_INTERVAL)) {
+        FanTraceFlush();
+        buffer = CurrentTraceBuffer();
+    }
+
+    // Storage is behind. The record is dropped, and as the tick isn't kept
+    // the next delta still counts from the last record in the trace.
+    if (!buffer) {
+        if (traceRecordsDropped++ == 0)
+            LOG_WARN("Sensor trace buffers full, dropping records");
+        return traceDropped;
+    }
+
+    if (buffer->used == 0)
+        traceBufferStartTick = tick;
+
+    u64 delta = tick - traceLastTick;
+    traceLastTick = tick;
+
+    u8 *pos = &buffer->data[buffer->used];
+    *pos++ = type;
+    do {
+        u8 byte = delta & 0x7F;
+        delta >>= 7;
+        *pos++ = byte | (delta ? 0x80 : 0);
+    } while (delta);
+
+    buffer->used = (pos - buffer->data) + payloadSize;
+    return pos;
+}
+
+static Result TraceSensorReadRegs(const u8 *regs, size_t count, u8 *out)
+{
+    Result rc = traceInner->sensorReadRegs(regs, count, out);
+
+    if (R_FAILED(rc)) {
+        u8 *payload = BeginTraceRecord(FANTRACE_RECORD_ERROR, 4);
+        for (int i = 0; i < 4; i++) {
+            payload[i] = (u8)(rc >> (8 * i));
+        }
+        return rc;
+    }
+
+    for (size_t done = 0; done < count; ) {
+        size_t chunk = count - done > FANTRACE_MAX_REGS ? FANTRACE_MAX_REGS : count - done;
+        u8 *payload = BeginTraceRecord(FANTRACE_RECORD_SENSOR, 1 + 2 * chunk);
+
+        *payload++ = (u8)chunk;
+        for (size_t i = 0; i < chunk; i++) {
+            *payload++ = regs[done + i];
+            *payload++ = out[done + i];
+        }
+        done += chunk;
+    }
+
+    return rc;
+}
+
+static bool TraceIsInFocus()
+{
+    bool inFocus = traceInner->isInFocus();
+
+    if (!traceFocusKnown || inFocus != traceLastFocus) {
+        u8 *payload = BeginTraceRecord(FANTRACE_RECORD_FOCUS, 1);
+        *payload = inFocus ? 1 : 0;
+        traceFocusKnown = true;
+        traceLastFocus = inFocus;
+    }
+
+    return inFocus;
+}
+
+bool FanTraceStart(const char *path)
+{
+    if (traceFile) return false;
+
+    traceFile = fopen(path, "wb");
+    if (!traceFile) {
+        LOG_WARN("Failed to open sensor trace %s", path);
+        return false;
+    }
+
+    traceInner = FanControllerGetBackend();
+    traceBackend = *traceInner;
+    traceBackend.sensorReadRegs = TraceSensorReadRegs;
+    traceBackend.isInFocus = TraceIsInFocus;
+
+    FanTraceHeader header = {
+        .magic = FANTRACE_MAGIC,
+        .version = FANTRACE_VERSION,
+        .tickFrequency = traceInner->getTickFrequency(),
+        .startTick = traceInner->getTick(),
+    };
+    fwrite(&header, sizeof(header), 1, traceFile);
+
+    for (int i = 0; i < FANTRACE_BUFFER_COUNT; i++) {
+        traceBuffers[i].used = 0;
+    }
+    atomic_store(&traceBuffersFilled, 0);
+    atomic_store(&traceBuffersWritten, 0);
+    traceRecordsDropped = 0;
+    traceLastTick = header.startTick;
+    traceFocusKnown = false;
+
+    FanControllerSetBackend(&traceBackend);
+    LOG_INFO("Recording sensor trace to %s", path);
+    return true;
+}
+
+void FanTraceStop()
+{
+    if (!traceFile) return;
+
+    // The controller is stopped, so the rest is written from here
+    FanControllerSetBackend(traceInner);
+    FanTraceFlush();
+    FanTraceWriteBuffers();
+
+    mutexLock(&traceFileMutex);
+    fclose(traceFile);
+    traceFile = NULL;
+    mutexUnlock(&traceFileMutex);
+    traceInner = NULL;
+}
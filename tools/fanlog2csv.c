@@ -0,0 +1,88 @@
+/*
+ * Host-side decoder for the binary fan controller log (LOG_FILE).
+ *
+ * Build: cc -O2 -Iinclude -o fanlog2csv tools/fanlog2csv.c
+ * Usage: fanlog2csv log.bin [out.csv]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fanlog.h"
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s log.bin [out.csv]\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    FILE *out = stdout;
+    if (argc == 3)
+    {
+        out = fopen(argv[2], "w");
+        if (!out)
+        {
+            perror(argv[2]);
+            fclose(in);
+            return 1;
+        }
+    }
+
+    FanLogHeader header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != FANLOG_MAGIC)
+    {
+        fprintf(stderr, "%s: not a fan controller log\n", argv[1]);
+        return 1;
+    }
+
+    // Newer writers may append fields; only the known prefix is decoded
+    if (header.version > FANLOG_VERSION || header.recordSize < sizeof(FanLogRecord) || header.tickFrequency == 0)
+    {
+        fprintf(stderr, "%s: unsupported log version %u (record size %u)\n", argv[1], header.version, header.recordSize);
+        return 1;
+    }
+
+    unsigned char *buffer = malloc(header.recordSize);
+    if (!buffer)
+        return 1;
+
+    fprintf(out, "time_s,soc_c,pcb_c,fan_level,emergency,sleep_mode,fan_written,limits_armed,fan_stalled\n");
+
+    unsigned long records = 0;
+    while (fread(buffer, header.recordSize, 1, in) == 1)
+    {
+        FanLogRecord record;
+        memcpy(&record, buffer, sizeof(record));
+
+        if (record.type != FANLOG_RECORD_SAMPLE)
+            continue;
+
+        fprintf(out, "%.3f,%.2f,%.2f,%.4f,%d,%d,%d,%d,%d\n",
+                (double)(int64_t)(record.tick - header.startTick) / header.tickFrequency,
+                record.socTemp / 100.0, record.pcbTemp / 100.0, record.fanLevel / 10000.0,
+                !!(record.flags & FAN_SAMPLE_FLAG_EMERGENCY),
+                !!(record.flags & FAN_SAMPLE_FLAG_SLEEP_MODE),
+                !!(record.flags & FAN_SAMPLE_FLAG_FAN_WRITTEN),
+                !!(record.flags & FAN_SAMPLE_FLAG_LIMITS_ARMED),
+                !!(record.flags & FAN_SAMPLE_FLAG_FAN_STALLED));
+        records++;
+    }
+
+    free(buffer);
+    fclose(in);
+    if (out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "%lu records\n", records);
+    return 0;
+}